@@ -1,7 +1,13 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define SPNG_STATIC
+#include <spng.h>
+
+#include "../src/assets.h"
+
 #ifndef _WIN32
 #include <dirent.h>
 #else
@@ -9,16 +15,40 @@
 #define NAME_MAX _MAX_PATH
 #endif // _WIN32
 
-static void header_preamble(FILE *file) {
-    fputs("#ifndef BUILT_ASSETS_H\n", file);
-    fputs("#define BUILT_ASSETS_H\n", file);
-    fputc('\n', file);
-}
+/* All PNGs are packed into square atlas pages, as small as they can be
+ * while still fitting everything into one page */
+#define ATLAS_MIN_PAGE_SIZE 64
+#define ATLAS_MAX_PAGE_SIZE 2048
+/* Empty border around each image, filled by repeating its edge pixels */
+#define ATLAS_PADDING 1
 
-static void source_preamble(FILE *file, const char *header_name) {
-    fprintf(file, "#include \"%s\"\n", header_name);
-    fputc('\n', file);
-}
+struct image {
+    char name[NAME_MAX];
+    unsigned char *pixels;
+    size_t width, height;
+    size_t page, x, y;
+};
+
+struct atlas {
+    struct image *images;
+    size_t count;
+    size_t capacity;
+    size_t page_size;
+    size_t page_count;
+};
+
+struct entry {
+    char name[BH_ASSET_NAME_SIZE];
+    enum BH_AssetType type;
+    unsigned char *data;
+    size_t size;
+};
+
+struct pack {
+    struct entry *entries;
+    size_t count;
+    size_t capacity;
+};
 
 static void remove_extension(char *string, size_t n) {
     for (size_t i = 0; i < n; i++) {
@@ -36,21 +66,137 @@ static size_t file_size(FILE* file) {
     return length;
 }
 
-static void write_file_data(FILE *dest_file, FILE *file) {
-    size_t length = file_size(file);
+static unsigned char *read_file(FILE *file, size_t *length) {
+    *length = file_size(file);
+    unsigned char *buffer = malloc(*length + 1);
+    if (fread(buffer, 1, *length, file) != *length) {
+        free(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+static bool has_extension(const char *file_name, const char *extension) {
+    size_t length = strlen(file_name);
+    size_t extension_length = strlen(extension);
+    return length > extension_length &&
+           strcmp(file_name + length - extension_length, extension) == 0;
+}
+
+static enum BH_AssetType asset_type(const char *file_name) {
+    if (has_extension(file_name, ".glsl")) {
+        return BH_ASSET_SHADER;
+    }
+    if (has_extension(file_name, ".otf") || has_extension(file_name, ".ttf")) {
+        return BH_ASSET_FONT;
+    }
+    return BH_ASSET_RAW;
+}
+
+/* Takes ownership of `data` */
+static void add_entry(
+    struct pack *pack, const char *name, enum BH_AssetType type, unsigned char *data, size_t size
+) {
+    if (strlen(name) >= BH_ASSET_NAME_SIZE) {
+        fprintf(stderr, "Asset name `%s` is too long\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (pack->count >= pack->capacity) {
+        pack->capacity = pack->capacity ? pack->capacity * 2 : 16;
+        pack->entries = realloc(pack->entries, pack->capacity * sizeof(struct entry));
+    }
 
-    unsigned char *buffer = malloc(length);
-    fread(buffer, 1, length, file);
+    struct entry *entry = &pack->entries[pack->count++];
+    memset(entry->name, 0, BH_ASSET_NAME_SIZE);
+    strcpy(entry->name, name);
+    entry->type = type;
+    entry->data = data;
+    entry->size = size;
+}
 
-    for (size_t i = 0; i < length; i++) {
-        fprintf(dest_file, "0x%02x, ", buffer[i]);
+static unsigned char *decode_png(FILE *file, size_t *width, size_t *height) {
+    size_t length;
+    unsigned char *buffer = read_file(file, &length);
+    if (buffer == NULL) {
+        return NULL;
     }
-    fputs("0x00", dest_file);
 
+    unsigned char *pixels = NULL;
+    spng_ctx *ctx = spng_ctx_new(0);
+    struct spng_ihdr ihdr;
+    size_t decoded_size;
+
+    if (ctx == NULL || spng_set_png_buffer(ctx, buffer, length) ||
+        spng_get_ihdr(ctx, &ihdr) ||
+        spng_decoded_image_size(ctx, SPNG_FMT_RGBA8, &decoded_size)) {
+        goto done;
+    }
+
+    pixels = malloc(decoded_size);
+    if (spng_decode_image(ctx, pixels, decoded_size, SPNG_FMT_RGBA8, 0)) {
+        free(pixels);
+        pixels = NULL;
+        goto done;
+    }
+
+    *width = ihdr.width;
+    *height = ihdr.height;
+
+done:
+    spng_ctx_free(ctx);
     free(buffer);
+    return pixels;
+}
+
+/* Decoded right away, so the runtime only ever uploads raw pixels */
+static void add_texture(struct pack *pack, const char *name, const struct image *image) {
+    size_t pixels_size = image->width * image->height * 4;
+    size_t size = sizeof(struct BH_PackTexture) + pixels_size;
+    unsigned char *data = malloc(size);
+
+    struct BH_PackTexture header = { .width = image->width, .height = image->height };
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), image->pixels, pixels_size);
+
+    add_entry(pack, name, BH_ASSET_TEXTURE, data, size);
 }
 
-static void write_files(FILE *header, FILE* source, const char *dir_name, const char *file_name) {
+/* Returns false if the image is too large for the atlas, and was added to
+ * the pack as a texture of its own instead */
+static bool add_image(struct pack *pack, struct atlas *atlas, const char *name, FILE *file) {
+    if (atlas->count >= atlas->capacity) {
+        atlas->capacity = atlas->capacity ? atlas->capacity * 2 : 16;
+        atlas->images = realloc(atlas->images, atlas->capacity * sizeof(struct image));
+    }
+
+    struct image *image = &atlas->images[atlas->count];
+    image->pixels = decode_png(file, &image->width, &image->height);
+    if (image->pixels == NULL) {
+        fprintf(stderr, "Couldn't decode `%s`\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (strlen(name) >= BH_ASSET_NAME_SIZE) {
+        fprintf(stderr, "Image name `%s` is too long\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (image->width + 2 * ATLAS_PADDING > ATLAS_MAX_PAGE_SIZE ||
+        image->height + 2 * ATLAS_PADDING > ATLAS_MAX_PAGE_SIZE) {
+        add_texture(pack, name, image);
+        free(image->pixels);
+        return false;
+    }
+
+    memcpy(image->name, name, NAME_MAX);
+    atlas->count++;
+    return true;
+}
+
+static void write_files(
+    struct pack *pack, struct atlas *atlas, const char *dir_name, const char *file_name
+) {
     char name[NAME_MAX];
     memcpy(name, file_name, NAME_MAX);
     remove_extension(name, NAME_MAX);
@@ -65,21 +211,32 @@ static void write_files(FILE *header, FILE* source, const char *dir_name, const
         fprintf(stderr, "Couldn't open file `%s`\n", full_path);
         return;
     }
+
+    if (has_extension(file_name, ".png")) {
+        if (add_image(pack, atlas, name, asset_file)) {
+            printf("Added `%s` to the atlas\n", file_name);
+        } else {
+            printf("Added `%s` to the pack, as it does not fit into an atlas page\n", file_name);
+        }
+        fclose(asset_file);
+        return;
+    }
     
-    size_t size = file_size(asset_file);
-    fprintf(header, "extern const unsigned char ASSET_%s[%lu];\n", name, (unsigned long)size + 1);
-    fprintf(source, "const unsigned char ASSET_%s[] = { ", name);
-    
-    write_file_data(source, asset_file);
+    size_t size;
+    unsigned char *data = read_file(asset_file, &size);
+    fclose(asset_file);
 
-    printf("Generated asset for `%s`\n", file_name);
+    if (data == NULL) {
+        fprintf(stderr, "Couldn't read file `%s`\n", full_path);
+        exit(EXIT_FAILURE);
+    }
 
-    fclose(asset_file); 
-    fputs(" };\n\n", source);
+    add_entry(pack, name, asset_type(file_name), data, size);
+    printf("Added `%s` to the pack\n", file_name);
 }
 
 #ifndef _WIN32
-static void entries(FILE *header, FILE* source, const char *dir_name) {
+static void entries(struct pack *pack, struct atlas *atlas, const char *dir_name) {
     DIR *assets_dir = opendir(dir_name);
     if (assets_dir == NULL) {
         fprintf(stderr, "Couldn't open directory `%s`\n", dir_name);
@@ -91,14 +248,14 @@ static void entries(FILE *header, FILE* source, const char *dir_name) {
         if (asset->d_type != DT_REG) {
             continue;
         }
-        write_files(header, source, dir_name, asset->d_name);
+        write_files(pack, atlas, dir_name, asset->d_name);
     }
     
     closedir(assets_dir);
 }
 #else
 
-static void entries(FILE *header, FILE* source, const char *dir_name) {
+static void entries(struct pack *pack, struct atlas *atlas, const char *dir_name) {
     const char append[] = "/*";
     char search[NAME_MAX + sizeof(append)];
     strcpy(search, dir_name);
@@ -114,7 +271,7 @@ static void entries(FILE *header, FILE* source, const char *dir_name) {
 
     if (!_findnext(handle, &asset)) {
         while (!_findnext(handle, &asset)) {
-            write_files(header, source, dir_name, asset.name);
+            write_files(pack, atlas, dir_name, asset.name);
         }
     }
 
@@ -122,41 +279,229 @@ static void entries(FILE *header, FILE* source, const char *dir_name) {
 }
 #endif // _WIN32
 
-static void header_addendum(FILE *file) {
-    fputs("#endif\n", file);
+static int compare_heights(const void *a, const void *b) {
+    const struct image *image = *(const struct image **)a;
+    const struct image *other = *(const struct image **)b;
+    return (other->height > image->height) - (other->height < image->height);
+}
+
+/* Shelf packing, tallest images first. Returns the number of pages used. */
+static size_t pack_atlas(struct image **sorted, size_t count, size_t page_size) {
+    size_t page = 0, x = 0, y = 0, shelf_height = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        struct image *image = sorted[i];
+        size_t width = image->width + 2 * ATLAS_PADDING;
+        size_t height = image->height + 2 * ATLAS_PADDING;
+
+        if (x + width > page_size) {
+            x = 0;
+            y += shelf_height;
+            shelf_height = 0;
+        }
+        if (y + height > page_size) {
+            page++;
+            x = 0;
+            y = 0;
+        }
+
+        image->page = page;
+        image->x = x + ATLAS_PADDING;
+        image->y = y + ATLAS_PADDING;
+
+        x += width;
+        if (height > shelf_height) {
+            shelf_height = height;
+        }
+    }
+
+    return count ? page + 1 : 0;
+}
+
+static void pack_smallest(struct atlas *atlas) {
+    struct image **sorted = malloc(atlas->count * sizeof(struct image *));
+    for (size_t i = 0; i < atlas->count; i++) {
+        sorted[i] = &atlas->images[i];
+    }
+    qsort(sorted, atlas->count, sizeof(struct image *), compare_heights);
+
+    atlas->page_size = ATLAS_MIN_PAGE_SIZE;
+    while (atlas->page_size < ATLAS_MAX_PAGE_SIZE &&
+           pack_atlas(sorted, atlas->count, atlas->page_size) > 1) {
+        atlas->page_size *= 2;
+    }
+    atlas->page_count = pack_atlas(sorted, atlas->count, atlas->page_size);
+
+    free(sorted);
+}
+
+/* Copies the image into its page, along with its padding */
+static void blit_image(unsigned char *page, size_t page_size, const struct image *image) {
+    long padding = ATLAS_PADDING;
+
+    for (long y = -padding; y < (long)image->height + padding; y++) {
+        long source_y = y < 0 ? 0 : y >= (long)image->height ? (long)image->height - 1 : y;
+
+        for (long x = -padding; x < (long)image->width + padding; x++) {
+            long source_x = x < 0 ? 0 : x >= (long)image->width ? (long)image->width - 1 : x;
+
+            const unsigned char *from = &image->pixels[4 * (source_y * image->width + source_x)];
+            unsigned char *to = &page[4 * ((image->y + y) * page_size + image->x + x)];
+            memcpy(to, from, 4);
+        }
+    }
+}
+
+static int compare_regions(const void *a, const void *b) {
+    return strcmp(((const struct BH_PackRegion *)a)->name, ((const struct BH_PackRegion *)b)->name);
+}
+
+/* Adds every page, and the table of regions, as entries of their own */
+static void write_atlas(struct pack *pack, struct atlas *atlas) {
+    pack_smallest(atlas);
+
+    size_t page_bytes = atlas->page_size * atlas->page_size * 4;
+
+    for (size_t p = 0; p < atlas->page_count; p++) {
+        unsigned char *page = calloc(page_bytes, 1);
+        for (size_t i = 0; i < atlas->count; i++) {
+            if (atlas->images[i].page == p) {
+                blit_image(page, atlas->page_size, &atlas->images[i]);
+            }
+        }
+
+        char name[BH_ASSET_NAME_SIZE];
+        snprintf(name, sizeof(name), BH_ATLAS_PAGE_ASSET, (unsigned)p);
+        add_entry(pack, name, BH_ASSET_ATLAS_PAGE, page, page_bytes);
+    }
+
+    size_t table_size = sizeof(struct BH_PackAtlas) + atlas->count * sizeof(struct BH_PackRegion);
+    unsigned char *table = calloc(table_size, 1);
+
+    struct BH_PackAtlas *header = (struct BH_PackAtlas *)table;
+    header->page_size = atlas->page_size;
+    header->page_count = atlas->page_count;
+    header->region_count = atlas->count;
+
+    struct BH_PackRegion *regions = (struct BH_PackRegion *)(header + 1);
+    for (size_t i = 0; i < atlas->count; i++) {
+        const struct image *image = &atlas->images[i];
+        float size = (float)atlas->page_size;
+
+        strcpy(regions[i].name, image->name);
+        regions[i].page = image->page;
+        regions[i].u0 = image->x / size;
+        regions[i].v0 = image->y / size;
+        regions[i].u1 = (image->x + image->width) / size;
+        regions[i].v1 = (image->y + image->height) / size;
+
+        free(image->pixels);
+    }
+    qsort(regions, atlas->count, sizeof(struct BH_PackRegion), compare_regions);
+
+    add_entry(pack, BH_ATLAS_ASSET, BH_ASSET_ATLAS, table, table_size);
+
+    printf(
+        "Packed %lu images into %lu atlas page(s) of %lux%lu\n", (unsigned long)atlas->count,
+        (unsigned long)atlas->page_count, (unsigned long)atlas->page_size,
+        (unsigned long)atlas->page_size
+    );
+
+    free(atlas->images);
+}
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const struct entry *)a)->name, ((const struct entry *)b)->name);
+}
+
+static size_t align(size_t offset) {
+    return (offset + BH_PACK_ALIGNMENT - 1) / BH_PACK_ALIGNMENT * BH_PACK_ALIGNMENT;
+}
+
+static void write_padding(FILE *file, size_t from, size_t to) {
+    for (; from < to; from++) {
+        fputc('\0', file);
+    }
+}
+
+static bool write_pack(FILE *file, struct pack *pack) {
+    qsort(pack->entries, pack->count, sizeof(struct entry), compare_entries);
+
+    for (size_t i = 1; i < pack->count; i++) {
+        if (strcmp(pack->entries[i - 1].name, pack->entries[i].name) == 0) {
+            fprintf(stderr, "More than one asset is named `%s`\n", pack->entries[i].name);
+            return false;
+        }
+    }
+
+    struct BH_PackHeader header = { .version = BH_PACK_VERSION, .entry_count = pack->count };
+    memcpy(header.magic, BH_PACK_MAGIC, 4);
+    fwrite(&header, sizeof(header), 1, file);
+
+    size_t offset = sizeof(header) + pack->count * sizeof(struct BH_PackEntry);
+    for (size_t i = 0; i < pack->count; i++) {
+        const struct entry *entry = &pack->entries[i];
+        offset = align(offset);
+
+        struct BH_PackEntry index = {
+            .offset = offset,
+            .size = entry->size,
+            .type = entry->type,
+            .hash = BH_HashAsset(entry->data, entry->size),
+        };
+        memcpy(index.name, entry->name, BH_ASSET_NAME_SIZE);
+        fwrite(&index, sizeof(index), 1, file);
+
+        /* With its terminating zero */
+        offset += entry->size + 1;
+    }
+
+    offset = sizeof(header) + pack->count * sizeof(struct BH_PackEntry);
+    for (size_t i = 0; i < pack->count; i++) {
+        const struct entry *entry = &pack->entries[i];
+        write_padding(file, offset, align(offset));
+        offset = align(offset);
+
+        fwrite(entry->data, 1, entry->size, file);
+        fputc('\0', file);
+        offset += entry->size + 1;
+
+        free(entry->data);
+    }
+
+    free(pack->entries);
+
+    printf("Wrote %lu assets, %lu bytes\n", (unsigned long)pack->count, (unsigned long)offset);
+    return !ferror(file);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 4) {
-        fprintf(stderr, "Provide assets directory and source name and header name as arguments!\n");
+    if (argc < 3) {
+        fprintf(stderr, "Provide assets directory and pack name as arguments!\n");
         goto error;    
     }
 
     const char *assets_dir = argv[1];
-    const char *source_name = argv[2];
-    const char *header_name = argv[3];
+    const char *pack_name = argv[2];
 
-    FILE *source = fopen(source_name, "w");
-    if (source == NULL) {
-        fprintf(stderr, "Couldn't open source file `%s`\n", argv[3]);
+    FILE *pack_file = fopen(pack_name, "wb");
+    if (pack_file == NULL) {
+        fprintf(stderr, "Couldn't open pack file `%s`\n", pack_name);
         goto error;
     }
 
-    FILE *header = fopen(header_name, "w");
-    if (header == NULL) {
-        fprintf(stderr, "Couldn't open header file `%s`\n", argv[2]);
+    struct pack pack = { 0 };
+    struct atlas atlas = { 0 };
+    entries(&pack, &atlas, assets_dir);
+    write_atlas(&pack, &atlas);
+
+    bool written = write_pack(pack_file, &pack);
+    if (fclose(pack_file) != 0 || !written) {
+        fprintf(stderr, "Couldn't write pack file `%s`\n", pack_name);
+        remove(pack_name);
         goto error;
     }
 
-    /* Write to files */
-    header_preamble(header);
-    source_preamble(source, header_name);
-    entries(header, source, assets_dir);
-    header_addendum(header);
-
-    /* Clean up */
-    fclose(header);
-
     /* Success! */
     return EXIT_SUCCESS;
 
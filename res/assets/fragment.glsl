@@ -3,7 +3,7 @@
 #extension GL_ARB_bindless_texture : require
 
 in vec2 fUVs;
-flat in uint fInstance;
+flat in uint fTexture;
 flat in uint fFlags;
 flat in vec4 fColour;
 
@@ -14,8 +14,7 @@ layout(binding = 3, std430) readonly buffer ssbo2 {
 out vec4 FragColor;
   
 void main() {
-    vec2 uvs = vec2(fUVs.x, 1.0 - fUVs.y);
-    vec4 sampled = texture(sprite_textures[fInstance], uvs);
+    vec4 sampled = texture(sprite_textures[fTexture], fUVs);
 
     vec4 tint = mix(vec4(1.0), fColour, fFlags & 2);
     vec4 color = mix(sampled, vec4(tint.rgb, sampled.r), fFlags & 1);
@@ -5,29 +5,53 @@ layout (location = 1) in vec2 aUVs;
 
 uniform mat4 projection_matrix;
 
+/* Matches struct BH_Sprite */
 struct sprite {
-    mat4 transform;
-    vec4 colour;
-    uint flags;
+    vec2 position;
+    vec2 half_size;
+    uint rotation;
+    float depth;
+    uint colour;
+    uint texture_flags;
 };
 
 layout(binding = 2, std430) readonly buffer ssbo1 {
     sprite sprite_data[];
 };
 
+/* Matches struct BH_TextureRegion */
+struct region {
+    vec4 uvs;
+    uint texture;
+};
+
+layout(binding = 4, std430) readonly buffer ssbo3 {
+    region regions[];
+};
+
 out vec2 fUVs;
-flat out uint fInstance;
+flat out uint fTexture;
 flat out uint fFlags;
 flat out vec4 fColour;
 
 void main() {
-    sprite sp = sprite_data[gl_InstanceID];
+    sprite sp = sprite_data[gl_BaseInstance + gl_InstanceID];
+
+    vec2 cos_sin = unpackSnorm2x16(sp.rotation);
+    mat4 transform = mat4(
+        vec4(sp.half_size.x * cos_sin.x, sp.half_size.x * cos_sin.y, 0.0, 0.0),
+        vec4(-sp.half_size.y * cos_sin.y, sp.half_size.y * cos_sin.x, 0.0, 0.0),
+        vec4(0.0, 0.0, 1.0, 0.0),
+        vec4(sp.position, sp.depth, 1.0)
+    );
+
+    gl_Position = projection_matrix * transform * vec4(aPos, 1.0);
 
-    gl_Position = projection_matrix * sp.transform * vec4(aPos, 1.0);
+    region rg = regions[sp.texture_flags & 0xffffu];
 
-    fUVs = aUVs;
-    fInstance = gl_InstanceID;
-    fFlags = sp.flags;
-    fColour = sp.colour;
+    fUVs = mix(rg.uvs.xy, rg.uvs.zw, vec2(aUVs.x, 1.0 - aUVs.y));
+    fTexture = rg.texture;
+    fFlags = sp.texture_flags >> 16;
+    fColour = unpackUnorm4x8(sp.colour);
 }
 
@@ -0,0 +1,200 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "assets.h"
+#include "error_macro.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif // _WIN32
+
+#ifndef _WIN32
+static const void* MapFile(const char* path, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        *size = st.st_size;
+        data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    /* The mapping keeps the file open */
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    /* Assets are fetched one by one, reading ahead would page in the
+     * neighbouring ones too */
+    posix_madvise(data, *size, POSIX_MADV_RANDOM);
+    return data;
+}
+
+static void UnmapFile(const void* data, size_t size) {
+    munmap((void*)data, size);
+}
+#else
+static const void* MapFile(const char* path, size_t* size) {
+    HANDLE file = CreateFileA(
+        path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
+    );
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    LARGE_INTEGER file_size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        *size = (size_t)file_size.QuadPart;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    CloseHandle(file);
+
+    if (mapping == NULL) {
+        return NULL;
+    }
+
+    /* The view keeps the mapping open */
+    const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    return data;
+}
+
+static void UnmapFile(const void* data, size_t size) {
+    (void)size;
+    UnmapViewOfFile(data);
+}
+#endif // _WIN32
+
+/* Only looks at the index, so no asset data is paged in yet */
+static bool ValidatePack(const struct BH_AssetPack* pack) {
+    const struct BH_PackHeader* header = (const struct BH_PackHeader*)pack->data;
+
+    if (pack->size < sizeof(*header) || memcmp(header->magic, BH_PACK_MAGIC, 4) != 0) {
+        error("Not an asset pack");
+        return false;
+    }
+
+    if (header->version != BH_PACK_VERSION) {
+        error("Asset pack version %u, expected %u", header->version, BH_PACK_VERSION);
+        return false;
+    }
+
+    size_t index_size = (size_t)header->entry_count * sizeof(struct BH_PackEntry);
+    if (index_size > pack->size - sizeof(*header)) {
+        error("Asset pack index is truncated");
+        return false;
+    }
+
+    const struct BH_PackEntry* entries = (const struct BH_PackEntry*)(header + 1);
+    for (size_t i = 0; i < header->entry_count; i++) {
+        const struct BH_PackEntry* entry = &entries[i];
+
+        if (memchr(entry->name, '\0', BH_ASSET_NAME_SIZE) == NULL) {
+            error("Asset %zu has no name", i);
+            return false;
+        }
+
+        /* Including the terminating zero */
+        if (entry->offset > pack->size || entry->size >= pack->size - entry->offset) {
+            error("Asset `%s` is out of bounds", entry->name);
+            return false;
+        }
+
+        if (i > 0 && strcmp(entries[i - 1].name, entry->name) >= 0) {
+            error("Asset pack index is not sorted at `%s`", entry->name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool BH_OpenAssetPack(struct BH_AssetPack* pack, const char* path) {
+    *pack = (struct BH_AssetPack){ 0 };
+
+    pack->data = MapFile(path, &pack->size);
+    if (pack->data == NULL) {
+        error("Couldn't map asset pack `%s`", path);
+        return false;
+    }
+
+    if (!ValidatePack(pack)) {
+        error("Invalid asset pack `%s`", path);
+        BH_CloseAssetPack(pack);
+        return false;
+    }
+
+    const struct BH_PackHeader* header = (const struct BH_PackHeader*)pack->data;
+    pack->entries = (const struct BH_PackEntry*)(header + 1);
+    pack->count = header->entry_count;
+
+    return true;
+}
+
+static int CompareEntryName(const void* name, const void* entry) {
+    return strcmp(name, ((const struct BH_PackEntry*)entry)->name);
+}
+
+const void* BH_GetAsset(
+    const struct BH_AssetPack* pack, const char* name, enum BH_AssetType type, size_t* size
+) {
+    const struct BH_PackEntry* entry =
+        bsearch(name, pack->entries, pack->count, sizeof(struct BH_PackEntry), CompareEntryName);
+
+    if (entry == NULL) {
+        error("No asset `%s`", name);
+        return NULL;
+    }
+
+    if (entry->type != type) {
+        error("Asset `%s` is of type %u, expected %u", name, entry->type, (unsigned)type);
+        return NULL;
+    }
+
+    const void* data = pack->data + entry->offset;
+
+#ifndef NDEBUG
+    if (BH_HashAsset(data, entry->size) != entry->hash) {
+        error("Asset `%s` is corrupt", name);
+        return NULL;
+    }
+#endif
+
+    if (size != NULL) {
+        *size = entry->size;
+    }
+    return data;
+}
+
+void BH_CloseAssetPack(struct BH_AssetPack* pack) {
+    if (pack->data != NULL) {
+        UnmapFile(pack->data, pack->size);
+    }
+    *pack = (struct BH_AssetPack){ 0 };
+}
+
+uint32_t BH_HashAsset(const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Written by res/asset_builder, found relative to the working directory */
+#ifndef BH_ASSET_PACK_PATH
+#define BH_ASSET_PACK_PATH "res/assets.pack"
+#endif
+
+/* The pack is a header, an index of entries sorted by name and then the
+ * data of each entry, 16 byte aligned. Every entry is followed by a zero
+ * byte not counted in its size, so text assets are C strings. All fields
+ * are in the byte order of the machine that built the pack. */
+#define BH_PACK_MAGIC "BHPK"
+#define BH_PACK_VERSION 1
+#define BH_PACK_ALIGNMENT 16
+#define BH_ASSET_NAME_SIZE 48
+
+enum BH_AssetType {
+    BH_ASSET_RAW,
+    BH_ASSET_SHADER,
+    BH_ASSET_FONT,
+    BH_ASSET_ATLAS,      /* a BH_PackAtlas followed by its regions */
+    BH_ASSET_ATLAS_PAGE, /* square RGBA8 pixels, top row first */
+    BH_ASSET_TEXTURE,    /* a BH_PackTexture followed by its RGBA8 pixels */
+};
+
+struct BH_PackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t padding;
+};
+
+struct BH_PackEntry {
+    char name[BH_ASSET_NAME_SIZE]; /* file name without its extension */
+    uint64_t offset;               /* from the start of the pack */
+    uint64_t size;
+    uint32_t type;
+    uint32_t hash; /* BH_HashAsset of the data */
+};
+
+/* Names of the atlas entries, which cannot clash with file names */
+#define BH_ATLAS_ASSET "atlas/regions"
+#define BH_ATLAS_PAGE_ASSET "atlas/page%u"
+
+struct BH_PackAtlas {
+    uint32_t page_size;
+    uint32_t page_count;
+    uint32_t region_count;
+    uint32_t padding;
+};
+
+/* Images too large for an atlas page, decoded like the pages are */
+struct BH_PackTexture {
+    uint32_t width;
+    uint32_t height;
+};
+
+/* Sorted by name, like the entries */
+struct BH_PackRegion {
+    char name[BH_ASSET_NAME_SIZE];
+    uint32_t page;
+    float u0, v0, u1, v1;
+};
+
+/* The whole pack is mapped read-only, so an asset's pages are only read in
+ * once it is first touched. Pointers into it stay valid until closed. */
+struct BH_AssetPack {
+    const unsigned char* data;
+    size_t size;
+    const struct BH_PackEntry* entries;
+    size_t count;
+};
+
+bool BH_OpenAssetPack(struct BH_AssetPack* pack, const char* path);
+/* Returns NULL if there is no asset `name` of `type` */
+const void* BH_GetAsset(
+    const struct BH_AssetPack* pack, const char* name, enum BH_AssetType type, size_t* size
+);
+void BH_CloseAssetPack(struct BH_AssetPack* pack);
+
+/* 32-bit FNV-1a */
+uint32_t BH_HashAsset(const void* data, size_t size);
@@ -0,0 +1,128 @@
+/* Times every broadphase on bullets crossing the screen at several entity
+ * counts, and prints the results. Built on its own with `make bench`. */
+#include "broadphase.h"
+#include "error_macro.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_TICKS 600
+#define BENCH_QUERIES 64
+#define BENCH_WIDTH 1280.0f
+#define BENCH_HEIGHT 720.0f
+
+struct BenchBullet {
+    struct vec2 position;
+    struct vec2 velocity;
+    struct BH_EntityHandle handle;
+};
+
+static float BenchRand(void) { return (float)rand() / (float)RAND_MAX; }
+
+/* Bullets leaving the screen respawn as new entities, like they would be
+ * despawned and fired again */
+static void RespawnBenchBullet(struct BenchBullet* bullet) {
+    float angle = BenchRand() * 6.2831853f;
+    float speed = 60.0f + BenchRand() * 180.0f;
+
+    bullet->position = (struct vec2){ BenchRand() * BENCH_WIDTH, BenchRand() * BENCH_HEIGHT };
+    bullet->velocity = (struct vec2){ cosf(angle) * speed, sinf(angle) * speed };
+    bullet->handle.generation++;
+}
+
+static bool CountBenchHit(struct BH_SpatialEntity* entity, void* data) {
+    (void)entity;
+    (*(size_t*)data)++;
+    return true;
+}
+
+/* Returns microseconds per tick of rebuilding and querying */
+static double RunBench(struct BH_Broadphase* broadphase, struct BenchBullet* bullets, size_t count) {
+    const struct BH_BB bb = { { -4.0f, -4.0f }, { 4.0f, 4.0f } };
+    const float dt = 1.0f / 60.0f;
+
+    srand(1);
+    for (size_t i = 0; i < count; i++) {
+        bullets[i].handle = (struct BH_EntityHandle){ .index = i };
+        RespawnBenchBullet(&bullets[i]);
+    }
+
+    size_t hits = 0;
+    clock_t start = clock();
+
+    for (size_t tick = 0; tick < BENCH_TICKS; tick++) {
+        BH_ClearBroadphase(broadphase);
+
+        for (size_t i = 0; i < count; i++) {
+            struct BenchBullet* bullet = &bullets[i];
+            bullet->position.x += bullet->velocity.x * dt;
+            bullet->position.y += bullet->velocity.y * dt;
+
+            if (!BH_IsPointInBox(
+                    (struct BH_BB){ { 0.0f, 0.0f }, { BENCH_WIDTH, BENCH_HEIGHT } },
+                    bullet->position
+                )) {
+                RespawnBenchBullet(bullet);
+            }
+
+            BH_InsertBroadphase(
+                broadphase, (struct BH_SpatialEntity){
+                                .point = bullet->position,
+                                .bb = BH_BoxToWorld(bullet->position, bb),
+                                .handle = bullet->handle,
+                            }
+            );
+        }
+
+        BH_BuildBroadphase(broadphase);
+
+        /* About what a player and a few homing shots would ask for */
+        for (size_t q = 0; q < BENCH_QUERIES; q++) {
+            struct vec2 centre = bullets[(tick * BENCH_QUERIES + q) % count].position;
+            struct BH_BB box = BH_BoxToWorld(centre, (struct BH_BB){ { -32, -32 }, { 32, 32 } });
+            BH_VisitBroadphase(broadphase, box, CountBenchHit, &hits);
+        }
+    }
+
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    return seconds * 1e6 / BENCH_TICKS;
+}
+
+int main(void) {
+    static const size_t counts[] = { 1000, 4000, 8000, 12000, 16000, 64000 };
+    const size_t max_count = counts[sizeof(counts) / sizeof(counts[0]) - 1];
+
+    struct BenchBullet* bullets = malloc(max_count * sizeof(struct BenchBullet));
+    if (bullets == NULL) {
+        error("Failed to allocate memory");
+        return 1;
+    }
+
+    printf("%10s %12s %12s %12s  (us per tick)\n", "entities", "grid", "qtree", "incremental");
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        double times[3] = { 0 };
+
+        for (size_t config = 0; config < 3; config++) {
+            struct BH_Broadphase broadphase;
+            if (!BH_InitBroadphase(
+                    &broadphase, config == 0 ? BH_BROADPHASE_GRID : BH_BROADPHASE_QTREE
+                )) {
+                continue;
+            }
+            if (config == 1) {
+                broadphase.as.qtree.incremental = false;
+            }
+
+            times[config] = RunBench(&broadphase, bullets, counts[c]);
+            BH_DeinitBroadphase(&broadphase);
+        }
+
+        printf("%10zu %12.1f %12.1f %12.1f\n", counts[c], times[0], times[1], times[2]);
+    }
+
+    free(bullets);
+    return 0;
+}
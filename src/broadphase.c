@@ -0,0 +1,163 @@
+#include "broadphase.h"
+#include "error_macro.h"
+
+#include <math.h>
+
+bool BH_InitBroadphase(struct BH_Broadphase* broadphase, enum BH_BroadphaseType type) {
+    broadphase->type = type;
+
+    switch (type) {
+    case BH_BROADPHASE_QTREE:
+        if (!BH_InitQTree(&broadphase->as.qtree, BH_QTREE_LEAF_CAPACITY, BH_QTREE_MAX_DEPTH)) {
+            return false;
+        }
+        broadphase->as.qtree.incremental = true;
+        return true;
+    case BH_BROADPHASE_GRID:
+        return BH_InitGrid(&broadphase->as.grid, 0.0f);
+    }
+
+    error("Unknown broadphase type %d", (int)type);
+    return false;
+}
+
+void BH_ClearBroadphase(struct BH_Broadphase* broadphase) {
+    switch (broadphase->type) {
+    case BH_BROADPHASE_QTREE:
+        BH_ClearQTree(&broadphase->as.qtree);
+        break;
+    case BH_BROADPHASE_GRID:
+        BH_ClearGrid(&broadphase->as.grid);
+        break;
+    }
+}
+
+bool BH_InsertBroadphase(struct BH_Broadphase* broadphase, struct BH_SpatialEntity entity) {
+    switch (broadphase->type) {
+    case BH_BROADPHASE_QTREE:
+        return BH_InsertQTree(&broadphase->as.qtree, entity);
+    case BH_BROADPHASE_GRID:
+        return BH_InsertGrid(&broadphase->as.grid, entity);
+    }
+    return false;
+}
+
+bool BH_BuildBroadphase(struct BH_Broadphase* broadphase) {
+    switch (broadphase->type) {
+    case BH_BROADPHASE_QTREE:
+        return BH_BuildQTree(&broadphase->as.qtree);
+    case BH_BROADPHASE_GRID:
+        return BH_BuildGrid(&broadphase->as.grid);
+    }
+    return false;
+}
+
+bool BH_VisitBroadphase(
+    struct BH_Broadphase* broadphase, struct BH_BB box, BH_SpatialVisitCB visit, void* data
+) {
+    switch (broadphase->type) {
+    case BH_BROADPHASE_QTREE:
+        return BH_VisitQTree(&broadphase->as.qtree, box, visit, data);
+    case BH_BROADPHASE_GRID:
+        return BH_VisitGrid(&broadphase->as.grid, box, visit, data);
+    }
+    return true;
+}
+
+struct Collector {
+    struct BH_SpatialEntity** entities;
+    size_t capacity;
+    size_t count;
+};
+
+static bool Collect(struct BH_SpatialEntity* entity, void* data) {
+    struct Collector* collector = data;
+    if (collector->count < collector->capacity) {
+        collector->entities[collector->count] = entity;
+    }
+    collector->count++;
+    return true;
+}
+
+size_t BH_QueryBroadphase(
+    struct BH_Broadphase* broadphase, struct BH_BB box, struct BH_SpatialEntity** entities,
+    size_t capacity
+) {
+    struct Collector collector = { .entities = entities, .capacity = capacity };
+    BH_VisitBroadphase(broadphase, box, Collect, &collector);
+    return collector.count;
+}
+
+struct BH_SpatialHit BH_QueryNearest(
+    struct BH_Broadphase* broadphase, struct vec2 point, float max_distance,
+    BH_SpatialFilterCB filter, void* data
+) {
+    struct BH_SpatialHit hit = { .entity = NULL };
+    BH_QueryKNearest(broadphase, point, max_distance, filter, data, &hit, 1);
+    return hit;
+}
+
+size_t BH_QueryKNearest(
+    struct BH_Broadphase* broadphase, struct vec2 point, float max_distance,
+    BH_SpatialFilterCB filter, void* data, struct BH_SpatialHit* hits, size_t k
+) {
+    struct BH_NearestSearch search = {
+        .point = point,
+        .max_distance = max_distance,
+        .filter = filter,
+        .data = data,
+        .hits = hits,
+        .k = k,
+    };
+
+    switch (broadphase->type) {
+    case BH_BROADPHASE_QTREE:
+        BH_KNearestQTree(&broadphase->as.qtree, &search);
+        break;
+    case BH_BROADPHASE_GRID:
+        BH_KNearestGrid(&broadphase->as.grid, &search);
+        break;
+    }
+
+    return search.count;
+}
+
+struct BH_SpatialHit BH_Raycast(
+    struct BH_Broadphase* broadphase, struct vec2 origin, struct vec2 direction,
+    float max_distance, BH_SpatialFilterCB filter, void* data
+) {
+    float length = sqrtf(direction.x * direction.x + direction.y * direction.y);
+    if (!(length > 0.0f)) {
+        return (struct BH_SpatialHit){ .entity = NULL };
+    }
+
+    struct BH_RaySearch search = {
+        .origin = origin,
+        .direction = { direction.x / length, direction.y / length },
+        .max_distance = max_distance,
+        .filter = filter,
+        .data = data,
+    };
+
+    switch (broadphase->type) {
+    case BH_BROADPHASE_QTREE:
+        BH_RaycastQTree(&broadphase->as.qtree, &search);
+        break;
+    case BH_BROADPHASE_GRID:
+        BH_RaycastGrid(&broadphase->as.grid, &search);
+        break;
+    }
+
+    return search.hit;
+}
+
+void BH_DeinitBroadphase(struct BH_Broadphase* broadphase) {
+    switch (broadphase->type) {
+    case BH_BROADPHASE_QTREE:
+        BH_DeinitQTree(&broadphase->as.qtree);
+        break;
+    case BH_BROADPHASE_GRID:
+        BH_DeinitGrid(&broadphase->as.grid);
+        break;
+    }
+}
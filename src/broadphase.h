@@ -0,0 +1,66 @@
+#pragma once
+
+#include "grid.h"
+#include "qtree.h"
+#include "spatial.h"
+#include <stdbool.h>
+
+enum BH_BroadphaseType {
+    BH_BROADPHASE_GRID,
+    BH_BROADPHASE_QTREE,
+};
+
+/* Whichever structure finds the entities near a box. Both are rebuilt from
+ * scratch every tick: cleared, filled with BH_InsertBroadphase and then
+ * built, after which they can be queried until next cleared. The tree
+ * adapts to clustered entities of any size, the grid is cheaper to rebuild
+ * when most entities are about the same size. */
+struct BH_Broadphase {
+    enum BH_BroadphaseType type;
+    union {
+        struct BH_QTree qtree;
+        struct BH_Grid grid;
+    } as;
+};
+
+/* With the defaults of each type: an incremental tree, and a grid with a
+ * fitted cell size */
+bool BH_InitBroadphase(struct BH_Broadphase* broadphase, enum BH_BroadphaseType type);
+void BH_ClearBroadphase(struct BH_Broadphase* broadphase);
+bool BH_InsertBroadphase(struct BH_Broadphase* broadphase, struct BH_SpatialEntity entity);
+bool BH_BuildBroadphase(struct BH_Broadphase* broadphase);
+/* Visits the entities whose boxes overlap `box`, returns false if `visit`
+ * stopped early. Neither form allocates. */
+bool BH_VisitBroadphase(
+    struct BH_Broadphase* broadphase, struct BH_BB box, BH_SpatialVisitCB visit, void* data
+);
+/* Writes up to `capacity` of the entities whose boxes overlap `box` to
+ * `entities` and returns how many there are in total, which may be more */
+size_t BH_QueryBroadphase(
+    struct BH_Broadphase* broadphase, struct BH_BB box, struct BH_SpatialEntity** entities,
+    size_t capacity
+);
+
+/* Distances are from `point` to the nearest point of each entity's box.
+ * Only entities within `max_distance`, which may be INFINITY, that pass
+ * `filter` are found. */
+
+/* `entity` is NULL if there is none */
+struct BH_SpatialHit BH_QueryNearest(
+    struct BH_Broadphase* broadphase, struct vec2 point, float max_distance,
+    BH_SpatialFilterCB filter, void* data
+);
+/* Writes the `k` nearest to `hits`, nearest first, and returns how many
+ * there were */
+size_t BH_QueryKNearest(
+    struct BH_Broadphase* broadphase, struct vec2 point, float max_distance,
+    BH_SpatialFilterCB filter, void* data, struct BH_SpatialHit* hits, size_t k
+);
+/* The first entity whose box the ray enters, with the distance along the
+ * ray. `entity` is NULL if it hits nothing. */
+struct BH_SpatialHit BH_Raycast(
+    struct BH_Broadphase* broadphase, struct vec2 origin, struct vec2 direction,
+    float max_distance, BH_SpatialFilterCB filter, void* data
+);
+
+void BH_DeinitBroadphase(struct BH_Broadphase* broadphase);
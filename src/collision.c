@@ -0,0 +1,184 @@
+#include "collision.h"
+#include "error_macro.h"
+#include "spatial.h"
+
+#include <stdlib.h>
+
+#define COLLISIONS_START_CAPACITY 64
+#define COLLISIONS_GROW_FACTOR 2
+
+static bool Reserve(void** array, size_t element_size, size_t* capacity, size_t count) {
+    if (count <= *capacity) {
+        return true;
+    }
+
+    size_t grown = *capacity ? *capacity : COLLISIONS_START_CAPACITY;
+    while (grown < count) {
+        grown *= COLLISIONS_GROW_FACTOR;
+    }
+
+    void* data = realloc(*array, grown * element_size);
+    if (data == NULL) {
+        error("Failed to allocate memory");
+        return false;
+    }
+
+    *array = data;
+    *capacity = grown;
+    return true;
+}
+
+bool BH_RegisterCollisionHandler(
+    struct BH_Collisions* collisions, struct BH_CollisionHandler handler
+) {
+    if (handler.callback == NULL) {
+        error("handler.callback == NULL");
+        return false;
+    }
+
+    if (!Reserve(
+            (void**)&collisions->handlers, sizeof(struct BH_CollisionHandler),
+            &collisions->handler_capacity, collisions->handler_count + 1
+        )) {
+        return false;
+    }
+
+    collisions->handlers[collisions->handler_count++] = handler;
+    return true;
+}
+
+struct PairSearch {
+    struct BH_Collisions* collisions;
+    struct BH_EntityPool* pool;
+    size_t entity;
+    struct BH_Shape shape; /* of `entity`, in world space */
+};
+
+static bool PushPair(struct BH_Collisions* collisions, size_t entity, size_t other) {
+    if (!Reserve(
+            (void**)&collisions->pairs, sizeof(struct BH_CollisionPair),
+            &collisions->pair_capacity, collisions->pair_count + 1
+        )) {
+        return false;
+    }
+
+    collisions->pairs[collisions->pair_count++] = (struct BH_CollisionPair){
+        .entity = entity,
+        .other = other,
+    };
+    return true;
+}
+
+static bool FlushShapes(struct PairSearch* search) {
+    struct BH_ShapeBatch* shapes = &search->collisions->shapes;
+    uint32_t hits = BH_CollideShapeBatch(search->shape, shapes);
+
+    for (size_t i = 0; i < shapes->count; i++) {
+        if ((hits & 1u << i) && !PushPair(search->collisions, search->entity, shapes->ids[i])) {
+            return false;
+        }
+    }
+
+    BH_ClearShapeBatch(shapes);
+    return true;
+}
+
+static bool AddPair(struct BH_SpatialEntity* found, void* data) {
+    struct PairSearch* search = data;
+    struct BH_Collisions* collisions = search->collisions;
+    struct BH_EntityPool* pool = search->pool;
+    size_t entity = search->entity;
+
+    size_t other = BH_EntityIndex(pool, found->handle);
+    if (other == BH_INVALID_ENTITY || other == entity ||
+        !(pool->masks[entity] & pool->layers[other])) {
+        return true;
+    }
+
+    /* Overlaps are symmetric, so `other` finds this pair itself */
+    if ((pool->masks[other] & pool->layers[entity]) && other < entity) {
+        return true;
+    }
+
+    /* The broadphase already compared the boxes */
+    struct BH_Shape shape = pool->shapes[other];
+    if (search->shape.type == BH_SHAPE_BOX && shape.type == BH_SHAPE_BOX) {
+        return PushPair(collisions, entity, other);
+    }
+
+    shape = BH_ShapeToWorld(shape, pool->bbs[other], pool->positions[other]);
+    if (!BH_AddToShapeBatch(&collisions->shapes, shape, other)) {
+        if (BH_DoShapesOverlap(search->shape, shape)) {
+            return PushPair(collisions, entity, other);
+        }
+        return true;
+    }
+
+    if (collisions->shapes.count == BH_SHAPE_BATCH) {
+        return FlushShapes(search);
+    }
+    return true;
+}
+
+bool BH_FindCollisions(
+    struct BH_Collisions* collisions, struct BH_EntityPool* pool, struct BH_Broadphase* broadphase
+) {
+    collisions->pair_count = 0;
+
+    struct PairSearch search = { .collisions = collisions, .pool = pool };
+    for (size_t i = 0; i < pool->count; i++) {
+        if (pool->masks[i] == 0) {
+            continue;
+        }
+
+        search.entity = i;
+        search.shape = BH_ShapeToWorld(pool->shapes[i], pool->bbs[i], pool->positions[i]);
+        struct BH_BB bb = BH_BoxToWorld(pool->positions[i], pool->bbs[i]);
+        if (!BH_VisitBroadphase(broadphase, bb, AddPair, &search) || !FlushShapes(&search)) {
+            BH_ClearShapeBatch(&collisions->shapes);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void BH_RunCollisionHandlers(
+    struct BH_Context* ctx, struct BH_Collisions* collisions, struct BH_EntityPool* pool
+) {
+    if (!Reserve(
+            (void**)&collisions->batch, sizeof(struct BH_CollisionPair),
+            &collisions->batch_capacity, collisions->pair_count
+        )) {
+        return;
+    }
+
+    for (size_t h = 0; h < collisions->handler_count; h++) {
+        const struct BH_CollisionHandler* handler = &collisions->handlers[h];
+        size_t count = 0;
+
+        for (size_t p = 0; p < collisions->pair_count; p++) {
+            struct BH_CollisionPair pair = collisions->pairs[p];
+            uint32_t entity = pool->layers[pair.entity];
+            uint32_t other = pool->layers[pair.other];
+
+            if ((entity & handler->layer) && (other & handler->mask)) {
+                collisions->batch[count++] = pair;
+            } else if ((other & handler->layer) && (entity & handler->mask)) {
+                collisions->batch[count++] = (struct BH_CollisionPair){
+                    .entity = pair.other,
+                    .other = pair.entity,
+                };
+            }
+        }
+
+        handler->callback(ctx, collisions->batch, count);
+    }
+}
+
+void BH_DeinitCollisions(struct BH_Collisions* collisions) {
+    free(collisions->handlers);
+    free(collisions->pairs);
+    free(collisions->batch);
+    *collisions = (struct BH_Collisions){ 0 };
+}
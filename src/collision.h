@@ -0,0 +1,66 @@
+#pragma once
+
+#include "broadphase.h"
+#include "entities.h"
+#include "shapes.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct BH_Context;
+
+/* Two entities whose shapes overlap, as dense indices into the pool. They
+ * stay valid until the end of the tick, as despawns are deferred. */
+struct BH_CollisionPair {
+    size_t entity;
+    size_t other;
+};
+
+typedef void (*BH_CollisionCB)(
+    struct BH_Context* ctx, const struct BH_CollisionPair* pairs, size_t count
+);
+
+/* Called once per tick with every pair where `entity` is on one of the
+ * `layer` bits and `other` on one of the `mask` bits, even if the batch
+ * is empty. */
+struct BH_CollisionHandler {
+    BH_CollisionCB callback;
+    uint32_t layer;
+    uint32_t mask;
+};
+
+/* Two entities form a pair if either one's mask has a bit of the other's
+ * layer. Each pair is found once, by a broadphase query from whichever of
+ * the two masks the other, so entities with no mask cost nothing. Pairs
+ * and batches are kept between ticks and only ever grow.
+ *
+ * Unless both are plain boxes, what the query finds is then tested shape
+ * against shape, `shapes` at a time. */
+struct BH_Collisions {
+    struct BH_CollisionHandler* handlers;
+    size_t handler_count;
+    size_t handler_capacity;
+
+    struct BH_CollisionPair* pairs;
+    size_t pair_count;
+    size_t pair_capacity;
+
+    /* The pairs of one handler, oriented its way round */
+    struct BH_CollisionPair* batch;
+    size_t batch_capacity;
+
+    /* Candidates of the current query, waiting for the narrow phase */
+    struct BH_ShapeBatch shapes;
+};
+
+bool BH_RegisterCollisionHandler(
+    struct BH_Collisions* collisions, struct BH_CollisionHandler handler
+);
+/* `broadphase` must have been built from `pool` as it is now */
+bool BH_FindCollisions(
+    struct BH_Collisions* collisions, struct BH_EntityPool* pool, struct BH_Broadphase* broadphase
+);
+void BH_RunCollisionHandlers(
+    struct BH_Context* ctx, struct BH_Collisions* collisions, struct BH_EntityPool* pool
+);
+void BH_DeinitCollisions(struct BH_Collisions* collisions);
@@ -0,0 +1,293 @@
+#include "emitter.h"
+#include "error_macro.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define EMITTERS_START_CAPACITY 16
+#define EMITTERS_GROW_FACTOR 2
+
+#define PI 3.14159265358979323846f
+
+bool BH_AddEmitter(struct BH_Emitters* emitters, struct BH_Emitter emitter) {
+    if (emitters->count >= emitters->capacity) {
+        size_t capacity = emitters->capacity ? emitters->capacity * EMITTERS_GROW_FACTOR
+                                             : EMITTERS_START_CAPACITY;
+        struct BH_Emitter* grown =
+            realloc(emitters->emitters, capacity * sizeof(struct BH_Emitter));
+        if (grown == NULL) {
+            error("Failed to allocate memory");
+            return false;
+        }
+        emitters->emitters = grown;
+        emitters->capacity = capacity;
+    }
+
+    /* xorshift must not be seeded with 0 */
+    if (emitter.seed == 0) {
+        emitter.seed = 0x9e3779b9u + (uint32_t)emitters->count;
+    }
+
+    emitters->emitters[emitters->count++] = emitter;
+    return true;
+}
+
+void BH_RemoveEmitter(struct BH_Emitters* emitters, size_t index) {
+    emitters->emitters[index] = emitters->emitters[--emitters->count];
+}
+
+void BH_DeinitEmitters(struct BH_Emitters* emitters) {
+    free(emitters->emitters);
+    *emitters = (struct BH_Emitters){ 0 };
+}
+
+/* Uniform in [-1, 1] */
+static float RandomSigned(uint32_t* seed) {
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return (float)(x >> 8) * (2.0f / 16777215.0f) - 1.0f;
+}
+
+/* Describes bullet `k` of a volley as base + k * step (+ jitter) */
+struct Volley {
+    struct vec2 origin;
+    float first_angle;
+    float angle_step;
+    float speed;
+    float speed_step;
+    float radius;
+    float acceleration;
+};
+
+static void WriteBullet(
+    struct BH_EntityPool* pool, size_t entity, const struct Volley* volley, size_t k, float jitter
+) {
+    float angle = volley->first_angle + volley->angle_step * k + jitter;
+    float speed = volley->speed + volley->speed_step * k;
+    struct vec2 heading = { cosf(angle), sinf(angle) };
+
+    pool->positions[entity] = (struct vec2){ volley->origin.x + heading.x * volley->radius,
+                                             volley->origin.y + heading.y * volley->radius };
+    pool->velocities[entity] = (struct vec2){ heading.x * speed, heading.y * speed };
+    pool->accelerations[entity] =
+        (struct vec2){ heading.x * volley->acceleration, heading.y * volley->acceleration };
+    pool->rotations[entity] = angle;
+}
+
+#ifdef __SSE2__
+/* Cephes-style sincosf, accurate to a few ulp for the angle ranges emitters
+ * produce */
+static void SinCos4(__m128 x, __m128* sin_out, __m128* cos_out) {
+    /* x = y + q * pi/2 with y in [-pi/4, pi/4], pi/2 split in three parts */
+    __m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(2.0f / PI)));
+    __m128 qf = _mm_cvtepi32_ps(q);
+
+    __m128 y = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(1.5703125f)));
+    y = _mm_sub_ps(y, _mm_mul_ps(qf, _mm_set1_ps(4.837512969970703125e-4f)));
+    y = _mm_sub_ps(y, _mm_mul_ps(qf, _mm_set1_ps(7.54978995489188216e-8f)));
+
+    __m128 z = _mm_mul_ps(y, y);
+
+    __m128 s = _mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), z);
+    s = _mm_mul_ps(_mm_add_ps(s, _mm_set1_ps(8.3321608736e-3f)), z);
+    s = _mm_mul_ps(_mm_add_ps(s, _mm_set1_ps(-1.6666654611e-1f)), z);
+    s = _mm_add_ps(_mm_mul_ps(s, y), y);
+
+    __m128 c = _mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), z);
+    c = _mm_mul_ps(_mm_add_ps(c, _mm_set1_ps(-1.388731625493765e-3f)), z);
+    c = _mm_mul_ps(_mm_add_ps(c, _mm_set1_ps(4.166664568298827e-2f)), z);
+    c = _mm_mul_ps(c, z);
+    c = _mm_add_ps(_mm_sub_ps(c, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+    /* Odd quadrants swap sin and cos, the sign follows the quadrant */
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+    __m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+    __m128 cos_sign =
+        _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+
+    __m128 sin_r = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+    __m128 cos_r = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+
+    *sin_out = _mm_xor_ps(sin_r, sin_sign);
+    *cos_out = _mm_xor_ps(cos_r, cos_sign);
+}
+
+/* Four bullets at a time. Returns how many bullets were written. */
+static size_t WriteBulletsSSE(
+    struct BH_EntityPool* pool, size_t first, size_t count, const struct Volley* volley,
+    float spread, uint32_t* seed
+) {
+    float* positions = (float*)&pool->positions[first];
+    float* velocities = (float*)&pool->velocities[first];
+    float* accelerations = (float*)&pool->accelerations[first];
+    float* rotations = &pool->rotations[first];
+
+    const __m128 origin_x = _mm_set1_ps(volley->origin.x);
+    const __m128 origin_y = _mm_set1_ps(volley->origin.y);
+    const __m128 radius = _mm_set1_ps(volley->radius);
+    const __m128 acceleration = _mm_set1_ps(volley->acceleration);
+
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 index = _mm_add_ps(_mm_set1_ps((float)k), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+
+        __m128 angle = _mm_mul_ps(index, _mm_set1_ps(volley->angle_step));
+        angle = _mm_add_ps(_mm_set1_ps(volley->first_angle), angle);
+        if (spread > 0.0f) {
+            __m128 jitter = _mm_set_ps(
+                RandomSigned(seed), RandomSigned(seed), RandomSigned(seed), RandomSigned(seed)
+            );
+            angle = _mm_add_ps(angle, _mm_mul_ps(jitter, _mm_set1_ps(spread)));
+        }
+        __m128 speed = _mm_mul_ps(index, _mm_set1_ps(volley->speed_step));
+        speed = _mm_add_ps(_mm_set1_ps(volley->speed), speed);
+
+        __m128 sin4, cos4;
+        SinCos4(angle, &sin4, &cos4);
+
+        __m128 x = _mm_add_ps(origin_x, _mm_mul_ps(cos4, radius));
+        __m128 y = _mm_add_ps(origin_y, _mm_mul_ps(sin4, radius));
+        _mm_storeu_ps(&positions[2 * k], _mm_unpacklo_ps(x, y));
+        _mm_storeu_ps(&positions[2 * k + 4], _mm_unpackhi_ps(x, y));
+
+        x = _mm_mul_ps(cos4, speed);
+        y = _mm_mul_ps(sin4, speed);
+        _mm_storeu_ps(&velocities[2 * k], _mm_unpacklo_ps(x, y));
+        _mm_storeu_ps(&velocities[2 * k + 4], _mm_unpackhi_ps(x, y));
+
+        x = _mm_mul_ps(cos4, acceleration);
+        y = _mm_mul_ps(sin4, acceleration);
+        _mm_storeu_ps(&accelerations[2 * k], _mm_unpacklo_ps(x, y));
+        _mm_storeu_ps(&accelerations[2 * k + 4], _mm_unpackhi_ps(x, y));
+
+        _mm_storeu_ps(&rotations[k], angle);
+    }
+
+    return k;
+}
+#endif
+
+static struct vec2
+EmitterOrigin(const struct BH_EntityPool* pool, const struct BH_Emitter* emitter) {
+    size_t anchor = BH_EntityIndex(pool, emitter->anchor);
+    if (anchor == BH_INVALID_ENTITY) {
+        return emitter->position;
+    }
+    return vec2_add(pool->positions[anchor], emitter->position);
+}
+
+bool BH_FireEmitter(struct BH_EntityPool* pool, struct BH_Emitter* emitter) {
+    if (emitter->count == 0) {
+        return true;
+    }
+
+    struct BH_SpriteEntity bullet = emitter->bullet;
+    bullet.components |= BH_COMPONENT_MOTION;
+
+    size_t first;
+    size_t spawned = BH_SpawnEntities(pool, &bullet, emitter->count, &first);
+    if (spawned != emitter->count) {
+        error("Emitter could only spawn %zu of %zu bullets", spawned, emitter->count);
+    }
+
+    /* A full ring must not put the last bullet on top of the first */
+    size_t gaps = emitter->arc >= BH_TAU ? emitter->count : emitter->count - 1;
+
+    struct Volley volley = {
+        .origin = EmitterOrigin(pool, emitter),
+        .first_angle = emitter->count > 1 ? emitter->direction - emitter->arc * 0.5f
+                                          : emitter->direction,
+        .angle_step = gaps ? emitter->arc / gaps : 0.0f,
+        .speed = emitter->speed,
+        .speed_step = emitter->count > 1
+                          ? (emitter->speed_end - emitter->speed) / (emitter->count - 1)
+                          : 0.0f,
+        .radius = emitter->radius,
+        .acceleration = emitter->acceleration,
+    };
+
+    size_t written = 0;
+#ifdef __SSE2__
+    written = WriteBulletsSSE(pool, first, spawned, &volley, emitter->spread, &emitter->seed);
+#endif
+    for (size_t k = written; k < spawned; k++) {
+        float jitter = 0.0f;
+        if (emitter->spread > 0.0f) {
+            jitter = RandomSigned(&emitter->seed) * emitter->spread;
+        }
+        WriteBullet(pool, first + k, &volley, k, jitter);
+    }
+
+    /* Keep the direction small, so that the angles stay precise */
+    emitter->direction = fmodf(emitter->direction + emitter->spin, BH_TAU);
+
+    return spawned == emitter->count;
+}
+
+static bool IsEmitterDone(const struct BH_EntityPool* pool, const struct BH_Emitter* emitter) {
+    if (emitter->duration > 0.0f && emitter->age >= emitter->duration) {
+        return true;
+    }
+
+    /* Anchored emitters go away together with their entity */
+    bool anchored = emitter->anchor.generation != 0;
+    return anchored && !BH_IsEntityAlive(pool, emitter->anchor);
+}
+
+/* Advances the timer and returns the number of volleys due this tick */
+static size_t DueVolleys(struct BH_Emitter* emitter, float dt) {
+    if (emitter->rate <= 0.0f) {
+        return 0;
+    }
+
+    float interval = 1.0f / emitter->rate;
+    size_t volleys = 0;
+
+    emitter->timer += dt;
+    while (emitter->timer >= interval) {
+        emitter->timer -= interval;
+        volleys++;
+    }
+
+    return volleys;
+}
+
+void BH_TickEmitters(struct BH_Emitters* emitters, struct BH_EntityPool* pool, float dt) {
+    size_t i = 0;
+    while (i < emitters->count) {
+        emitters->emitters[i].age += dt;
+        if (IsEmitterDone(pool, &emitters->emitters[i])) {
+            BH_RemoveEmitter(emitters, i);
+        } else {
+            i++;
+        }
+    }
+
+    /* Reserve for every volley of this tick at once */
+    size_t total = 0;
+    for (i = 0; i < emitters->count; i++) {
+        struct BH_Emitter* emitter = &emitters->emitters[i];
+        emitter->pending = DueVolleys(emitter, dt);
+        total += emitter->pending * emitter->count;
+    }
+
+    if (total == 0 || !BH_ReserveEntities(pool, pool->count + total)) {
+        return;
+    }
+
+    for (i = 0; i < emitters->count; i++) {
+        struct BH_Emitter* emitter = &emitters->emitters[i];
+        for (; emitter->pending > 0; emitter->pending--) {
+            BH_FireEmitter(pool, emitter);
+        }
+    }
+}
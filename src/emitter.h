@@ -0,0 +1,61 @@
+#pragma once
+
+#include "entities.h"
+#include "entitydef.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A full turn, an `arc` of at least this is a ring */
+#define BH_TAU (2.0f * 3.14159265358979323846f)
+
+/* Fires volleys of bullets in rings, fans and spirals. All bullets of a
+ * volley are written straight into the entity pool, see BH_SpawnEntities. */
+struct BH_Emitter {
+    /* Every bullet is a copy of this, apart from its position and motion.
+     * `bullet.sprite.texture` is the bullet texture. */
+    struct BH_SpriteEntity bullet;
+
+    struct vec2 position;
+    /* If alive, `position` is relative to this entity. The emitter is
+     * removed once the entity despawns. */
+    struct BH_EntityHandle anchor;
+
+    size_t count;    /* bullets per volley */
+    float direction; /* centre of the volley, radians */
+    float arc;       /* angle covered by a volley, BH_TAU for a ring */
+    float spin;      /* added to `direction` after every volley */
+    float spread;    /* maximum random deviation per bullet, radians */
+    float radius;    /* distance from `position` the bullets start at */
+
+    /* Speed is interpolated from `speed` for the first bullet of a volley
+     * to `speed_end` for the last one. Bullets then accelerate along their
+     * heading up to `bullet.motion.max_speed`. */
+    float speed;
+    float speed_end;
+    float acceleration;
+
+    float rate;     /* volleys per second */
+    float duration; /* seconds until the emitter is removed, 0 for never */
+
+    /* Managed by the emitter */
+    float timer;
+    float age;
+    uint32_t seed;
+    size_t pending;
+};
+
+struct BH_Emitters {
+    struct BH_Emitter* emitters;
+    size_t count;
+    size_t capacity;
+};
+
+bool BH_AddEmitter(struct BH_Emitters* emitters, struct BH_Emitter emitter);
+/* Moves the last emitter into `index` */
+void BH_RemoveEmitter(struct BH_Emitters* emitters, size_t index);
+void BH_DeinitEmitters(struct BH_Emitters* emitters);
+
+/* Fires one volley right away */
+bool BH_FireEmitter(struct BH_EntityPool* pool, struct BH_Emitter* emitter);
+void BH_TickEmitters(struct BH_Emitters* emitters, struct BH_EntityPool* pool, float dt);
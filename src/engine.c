@@ -1,139 +1,147 @@
 #include "engine.h"
 #include "GLFW/glfw3.h"
+#include "broadphase.h"
+#include "collision.h"
+#include "emitter.h"
+#include "entities.h"
 #include "entitydef.h"
+#include "jobs.h"
 #include "matrix.h"
-#include "qtree.h"
+#include "motion.h"
+#include "shapes.h"
+#include "spatial.h"
+#include "system.h"
+#include "transform.h"
 
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-#include "../res/built_assets.h"
+#include "assets.h"
 #include "error_macro.h"
 #include "renderer.h"
 
 // #define RENDER_DEBUG_INFO
 
-void BH_SpawnEntity(struct BH_DELL* entities, struct BH_SpriteEntity entity) {
-    if (entities->entities == NULL) {
-        entities->entities = calloc(1, sizeof(struct BH_EntityLL));
-    }
-
-    if (entities->last == NULL) {
-        entities->entities->entity = entity;
-        entities->last = entities->entities;
-    } else {
-        entities->last->next = calloc(1, sizeof(struct BH_EntityLL));
-        entities->last->next->entity = entity;
-        entities->last = entities->last->next;
-    }
-}
-
-void BH_DeinitEntities(struct BH_EntityLL* entities) {
-    if (entities->next != NULL) {
-        BH_DeinitEntities(entities->next);
-    }
-    if (entities->entity.state) {
-        free(entities->entity.state);
-    }
-    free(entities);
-}
-
-static void UpdateEntityTransform(struct BH_SpriteEntity* entity) {
-    m4 model_matrix;
-    m4 translation;
-
-    m4_scale(model_matrix, entity->scale.x, entity->scale.y, 1.0f);
-    m4_translation(translation, entity->position.x, entity->position.y, entity->depth);
-    m4_multiply(model_matrix, translation);
-
-    memcpy(entity->sprite.transform, model_matrix, sizeof(m4));
-}
-
 #ifdef RENDER_DEBUG_INFO
 static void
-RenderBB(struct BH_Renderer* renderer, struct BH_BB bb, struct vec2 offset, GLuint64 texture) {
-    struct BH_Sprite hitbox_sprite = {
-        .texture_handle = texture,
-    };
-
+RenderBB(struct BH_Renderer* renderer, struct BH_BB bb, struct vec2 offset, uint16_t texture) {
     struct BH_BB globalised_bb = BH_BoxToWorld(offset, bb);
-    struct vec2 hitbox_centre = BH_BoxCentre(globalised_bb);
     struct vec2 hitbox_dimensions = BH_BoxDimensions(globalised_bb);
 
-    m4_scale(hitbox_sprite.transform, hitbox_dimensions.x / 2.0f, hitbox_dimensions.y / 2.0f, 1.0f);
-
-    m4 translation;
-    m4_translation(translation, hitbox_centre.x, hitbox_centre.y, 0.0f);
-    m4_multiply(hitbox_sprite.transform, translation);
+    struct BH_Sprite hitbox_sprite = {
+        .position = BH_BoxCentre(globalised_bb),
+        .half_size = { hitbox_dimensions.x / 2.0f, hitbox_dimensions.y / 2.0f },
+        .rotation = pack_snorm2x16(1.0f, 0.0f),
+        .texture = texture,
+    };
 
     BH_RenderBatch(renderer, hitbox_sprite);
 }
 #endif
 
 #ifdef RENDER_DEBUG_INFO
-static void RenderQTree(struct BH_Renderer* renderer, struct BH_QTree* qtree, GLuint64 texture) {
-    if (qtree == NULL) {
+static void
+RenderBroadphase(struct BH_Renderer* renderer, struct BH_Broadphase* broadphase, uint16_t texture) {
+    if (broadphase->type != BH_BROADPHASE_QTREE) {
         return;
     }
 
-    if (BH_IsQTreeLeaf(qtree)) {
-        RenderBB(renderer, qtree->bb, (struct vec2){ 0.0f, 0.0f }, texture);
-    } else {
-        RenderQTree(renderer, qtree->top_left, texture);
-        RenderQTree(renderer, qtree->top_right, texture);
-        RenderQTree(renderer, qtree->bottom_left, texture);
-        RenderQTree(renderer, qtree->bottom_right, texture);
+    struct BH_QTree* qtree = &broadphase->as.qtree;
+    for (size_t i = 0; i < qtree->node_count; i++) {
+        /* Empty leaves have inverted boxes */
+        struct BH_BB bb = qtree->nodes[i].bb;
+        if (BH_IsQTreeLeaf(&qtree->nodes[i]) && bb.top_left.x <= bb.bottom_right.x) {
+            RenderBB(renderer, bb, (struct vec2){ 0.0f, 0.0f }, texture);
+        }
     }
 }
 #endif
 
+#ifdef RENDER_DEBUG_INFO
+static void UpdateStatsText(struct BH_Renderer* renderer, size_t stats_text) {
+    struct BH_RenderStats stats = renderer->last_frame_stats;
+
+    char text[128];
+    snprintf(
+        text, sizeof(text), "%zu sprites, %zu draw calls, %zu KiB uploaded", stats.sprites,
+        stats.draw_calls, stats.bytes_uploaded / 1024
+    );
+
+    BH_SetUIText(renderer, stats_text, text);
+}
+#endif
+
 static void TickEntities(
-    struct BH_Context* state, struct BH_EntityLL* entities, struct BH_QTree* qtree,
+    struct BH_Context* state, struct BH_EntityPool* entities, struct BH_Broadphase* broadphase,
     struct BH_Renderer* renderer
 ) {
-    struct BH_QTree next_qtree = { .bb = qtree->bb };
+    BH_ClearBroadphase(broadphase);
+
+    for (size_t i = 0; i < entities->count; i++) {
+        BH_InsertBroadphase(
+            broadphase, (struct BH_SpatialEntity){
+                            .point = entities->positions[i],
+                            .bb = BH_BoxToWorld(entities->positions[i], entities->bbs[i]),
+                            .handle = BH_EntityHandleAt(entities, i),
+                        }
+        );
+    }
 
-    struct BH_EntityLL* node = entities;
+    if (!BH_BuildBroadphase(broadphase)) {
+        error("Couldn't build broadphase");
+    }
 
-    while (node != NULL) {
-        struct BH_SpriteEntity* entity = &node->entity;
+    if (!BH_FindCollisions(&state->collisions, entities, broadphase)) {
+        error("Couldn't find collisions");
+    }
+    BH_RunCollisionHandlers(state, &state->collisions, entities);
+
+    BH_IntegrateMotion(entities, state->dt);
+    BH_RunSystems(state, &state->systems, entities);
+
+    /* Callbacks may spawn entities, so `entities->count` is re-read on every
+     * iteration and the arrays must not be cached across the call. */
+    for (size_t i = 0; i < entities->count; i++) {
+        if (entities->callbacks[i]) {
+            entities->callbacks[i](state, i);
+            entities->dirty[i] = 1;
+        }
+    }
 
-        BH_InsertQTree(
-            &next_qtree, (struct BH_QTreeEntity){ .entity = entity, .point = entity->position }
-        );
+    BH_TickEmitters(&state->emitters, entities, state->dt);
 
-        entity->callback(state, entity);
-        UpdateEntityTransform(entity);
-        BH_RenderBatch(renderer, entity->sprite);
+    /* Despawns and grouping are deferred so that dense indices stay put
+     * while systems and callbacks run */
+    BH_FlushDespawns(entities);
+    BH_FlushSpawns(entities);
+
+    BH_UpdateTransforms(entities);
+
+    for (size_t i = 0; i < entities->count; i++) {
+        BH_RenderBatch(renderer, entities->sprites[i]);
 
 #ifdef RENDER_DEBUG_INFO
-        RenderBB(renderer, entity->bb, entity->position, state->debug_texture);
+        RenderBB(renderer, entities->bbs[i], entities->positions[i], state->debug_texture);
 #endif
-
-        node = node->next;
     }
 
 #ifdef RENDER_DEBUG_INFO
-    RenderQTree(renderer, qtree, state->green_debug_texture);
+    RenderBroadphase(renderer, broadphase, state->green_debug_texture);
+    UpdateStatsText(renderer, state->stats_text);
 #endif
 
-    BH_RenderText(
-        renderer, 32.0f, 32.0f, 0.5f, (struct BH_Colour){ 1.0f, 1.0f, 0.0f, 1.0f },
-        "The quick brown fox jumps over the lazy dog."
-    );
-
     BH_FinishBatch(renderer);
-
-    /* Update qtree */
-    BH_DeinitQTree(qtree);
-    *qtree = next_qtree;
 }
 
-bool BH_DoEntitiesCollide(struct BH_SpriteEntity* entity, struct BH_SpriteEntity* other) {
-    return BH_DoBoxesIntersect(
-        BH_BoxToWorld(entity->position, entity->bb), BH_BoxToWorld(other->position, other->bb)
+bool BH_DoEntitiesCollide(struct BH_EntityPool* entities, size_t entity, size_t other) {
+    struct BH_Shape shape = entities->shapes[entity];
+    struct BH_Shape other_shape = entities->shapes[other];
+    return BH_DoShapesOverlap(
+        BH_ShapeToWorld(shape, entities->bbs[entity], entities->positions[entity]),
+        BH_ShapeToWorld(other_shape, entities->bbs[other], entities->positions[other])
     );
 }
 
@@ -159,59 +167,118 @@ bool BH_GetKey(int glfw_key) {
 }
 
 bool BH_InitContext(struct BH_Context* ctx, void* user_state, BH_UserCB user_init) {
-    if (!BH_InitRenderer(&ctx->renderer)) {
-        error("Renderer initialisation failed");
+    ctx->renderer.headless = ctx->headless_ticks != 0;
+
+    if (!BH_OpenAssetPack(&ctx->assets, BH_ASSET_PACK_PATH)) {
+        error("Couldn't open assets");
         return false;
     }
 
-    glfwSetKeyCallback(ctx->renderer.window, GLFWKeyCB);
+    if (!BH_InitJobPool(&ctx->jobs, BH_CountJobThreads())) {
+        error("Job pool initialisation failed");
+        return false;
+    }
 
-#ifdef RENDER_DEBUG_INFO
-    ctx->debug_texture =
-        BH_LoadTexture(&ctx->renderer.textures, (void*)ASSET_debug, sizeof(ASSET_debug) - 1);
-    if (!ctx->debug_texture)
+    if (!BH_InitRenderer(&ctx->renderer, &ctx->assets, &ctx->jobs)) {
+        error("Renderer initialisation failed");
         return false;
+    }
 
-    ctx->green_debug_texture =
-        BH_LoadTexture(&ctx->renderer.textures, (void*)ASSET_green_debug, sizeof(ASSET_debug) - 1);
-    if (!ctx->green_debug_texture)
+    if (ctx->renderer.headless) {
+        ctx->dt = BH_HEADLESS_DT;
+    } else {
+        glfwSetKeyCallback(ctx->renderer.window, GLFWKeyCB);
+    }
+
+    if (!BH_InitEntities(&ctx->entities, 0)) {
+        error("Entity pool initialisation failed");
         return false;
+    }
+
+#ifdef RENDER_DEBUG_INFO
+    ctx->debug_texture = BH_GetAtlasRegion(&ctx->renderer.textures, "debug");
+    ctx->green_debug_texture = BH_GetAtlasRegion(&ctx->renderer.textures, "green_debug");
 #endif
 
-    ctx->entity_qtree.bb = (struct BH_BB){
-        .top_left = {   0.0f,   0.0f },
-        .bottom_right = { 640.0f, 480.0f },
-    };
+    BH_AddUIText(
+        &ctx->renderer, 32.0f, 32.0f, 0.5f, (struct BH_Colour){ 1.0f, 1.0f, 0.0f, 1.0f },
+        "The quick brown fox jumps over the lazy dog."
+    );
+
+#ifdef RENDER_DEBUG_INFO
+    ctx->stats_text = BH_AddUIText(
+        &ctx->renderer, 32.0f, 64.0f, 0.5f, (struct BH_Colour){ 0.0f, 1.0f, 0.0f, 1.0f }, ""
+    );
+#endif
+
+    if (!BH_InitBroadphase(&ctx->broadphase, ctx->broadphase_type)) {
+        error("Broadphase initialisation failed");
+        return false;
+    }
 
     ctx->user_state = user_state;
     if (!user_init(ctx, ctx->user_state))
         return false;
 
+    BH_FlushSpawns(&ctx->entities);
+
     return true;
 }
 
 static void BeginFrame(struct BH_Context* ctx) {
-    glfwSetTime(0.0);
-    glfwPollEvents();
+    if (!ctx->renderer.headless) {
+        glfwSetTime(0.0);
+        glfwPollEvents();
+    }
     BH_RendererBeginFrame(&ctx->renderer);
 }
 
 static void EndFrame(struct BH_Context* ctx) {
     BH_RendererEndFrame(&ctx->renderer);
-    ctx->dt = (float)glfwGetTime();
+    if (!ctx->renderer.headless) {
+        ctx->dt = (float)glfwGetTime();
+    }
 }
 
 static void DeinitContext(struct BH_Context* ctx) {
-    BH_DeinitQTree(&ctx->entity_qtree);
-    BH_DeinitEntities(ctx->entities.entities);
+    BH_DeinitCollisions(&ctx->collisions);
+    BH_DeinitBroadphase(&ctx->broadphase);
+    BH_DeinitSystems(&ctx->systems);
+    BH_DeinitEmitters(&ctx->emitters);
+    BH_DeinitEntities(&ctx->entities);
     BH_DeinitRenderer(&ctx->renderer);
+    BH_DeinitJobPool(&ctx->jobs);
+    BH_CloseAssetPack(&ctx->assets);
+}
+
+static void RunFrame(struct BH_Context* ctx) {
+    BeginFrame(ctx);
+    TickEntities(ctx, &ctx->entities, &ctx->broadphase, &ctx->renderer);
+    EndFrame(ctx);
+}
+
+static void RunHeadless(struct BH_Context* ctx) {
+    clock_t start = clock();
+
+    for (size_t tick = 0; tick < ctx->headless_ticks; tick++) {
+        RunFrame(ctx);
+    }
+
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf(
+        "%zu ticks in %.3f s (%.1f us per tick), %zu entities, %zu sprites in the last tick\n",
+        ctx->headless_ticks, seconds, seconds * 1e6 / ctx->headless_ticks, ctx->entities.count,
+        ctx->renderer.last_frame_stats.sprites
+    );
 }
 
 void BH_RunContext(struct BH_Context* ctx) {
-    while (!glfwWindowShouldClose(ctx->renderer.window)) {
-        BeginFrame(ctx);
-        TickEntities(ctx, ctx->entities.entities, &ctx->entity_qtree, &ctx->renderer);
-        EndFrame(ctx);
+    if (ctx->renderer.headless) {
+        RunHeadless(ctx);
+    } else {
+        while (!glfwWindowShouldClose(ctx->renderer.window)) {
+            RunFrame(ctx);
+        }
     }
     DeinitContext(ctx);
 }
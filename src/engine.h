@@ -2,31 +2,41 @@
 
 #include <stdbool.h>
 
+#include "assets.h"
+#include "broadphase.h"
+#include "collision.h"
+#include "emitter.h"
+#include "entities.h"
 #include "entitydef.h"
-#include "qtree.h"
+#include "jobs.h"
 #include "renderer.h"
+#include "system.h"
 
-struct BH_EntityLL {
-    struct BH_SpriteEntity entity;
-    struct BH_EntityLL* next;
-};
-
-struct BH_DELL {
-    struct BH_EntityLL* entities;
-    struct BH_EntityLL* last;
-};
+#define BH_HEADLESS_DT (1.0f / 60.0f)
 
 typedef bool (*BH_UserCB)(struct BH_Context* ctx, void* user_state);
 
 struct BH_Context {
+    struct BH_AssetPack assets;
+    struct BH_JobPool jobs;
     struct BH_Renderer renderer;
     float dt;
 
-    struct BH_DELL entities;
-    struct BH_QTree entity_qtree;
+    /* If set before BH_InitContext, runs this many ticks of BH_HEADLESS_DT
+     * without a window or GL and prints how long they took */
+    size_t headless_ticks;
 
-    GLuint64 debug_texture;
-    GLuint64 green_debug_texture;
+    struct BH_EntityPool entities;
+    struct BH_Emitters emitters;
+    struct BH_Systems systems;
+    /* Set before BH_InitContext to pick the broadphase */
+    enum BH_BroadphaseType broadphase_type;
+    struct BH_Broadphase broadphase;
+    struct BH_Collisions collisions;
+
+    uint16_t debug_texture;
+    uint16_t green_debug_texture;
+    size_t stats_text;
 
     void* user_state;
 };
@@ -36,7 +46,4 @@ void BH_RunContext(struct BH_Context* ctx);
 
 bool BH_GetKey(int glfw_key);
 
-void BH_SpawnEntity(struct BH_DELL* entities, struct BH_SpriteEntity entity);
-void BH_DeinitEntities(struct BH_EntityLL* entities);
-
-bool BH_DoEntitiesCollide(struct BH_SpriteEntity* entity, struct BH_SpriteEntity* other);
+bool BH_DoEntitiesCollide(struct BH_EntityPool* entities, size_t entity, size_t other);
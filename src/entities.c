@@ -0,0 +1,431 @@
+#include "entities.h"
+#include "error_macro.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENTITIES_START_CAPACITY 256
+#define ENTITIES_GROW_FACTOR 2
+#define NO_FREE_SLOT UINT32_MAX
+
+/* Every per-entity array of struct BH_EntityPool */
+#define ENTITY_FIELDS(X)                                                                           \
+    X(sprites)                                                                                     \
+    X(positions)                                                                                   \
+    X(scales)                                                                                      \
+    X(rotations)                                                                                   \
+    X(depths)                                                                                      \
+    X(bbs)                                                                                         \
+    X(shapes)                                                                                      \
+    X(types)                                                                                       \
+    X(components)                                                                                  \
+    X(layers)                                                                                      \
+    X(masks)                                                                                       \
+    X(velocities)                                                                                  \
+    X(accelerations)                                                                               \
+    X(angular_velocities)                                                                          \
+    X(max_speeds)                                                                                  \
+    X(dirty)                                                                                       \
+    X(cached_rotations)                                                                            \
+    X(callbacks)                                                                                   \
+    X(states)                                                                                      \
+    X(slot_indices)
+
+static bool GrowArray(void** array, size_t element_size, size_t capacity) {
+    void* grown = realloc(*array, capacity * element_size);
+    if (grown == NULL) {
+        error("Failed to allocate memory");
+        return false;
+    }
+    *array = grown;
+    return true;
+}
+
+static size_t GrownCapacity(size_t capacity, size_t required) {
+    if (capacity == 0) {
+        capacity = ENTITIES_START_CAPACITY;
+    }
+    while (capacity < required) {
+        capacity *= ENTITIES_GROW_FACTOR;
+    }
+    return capacity;
+}
+
+static bool ReserveEntities(struct BH_EntityPool* pool, size_t capacity) {
+    if (capacity <= pool->capacity) {
+        return true;
+    }
+
+#define GROW_FIELD(field) GrowArray((void**)&pool->field, sizeof(*pool->field), capacity) &&
+    if (!(ENTITY_FIELDS(GROW_FIELD) true)) {
+        return false;
+    }
+#undef GROW_FIELD
+
+    pool->capacity = capacity;
+    return true;
+}
+
+static bool ReserveSlots(struct BH_EntityPool* pool, size_t capacity) {
+    if (capacity <= pool->slot_capacity) {
+        return true;
+    }
+    if (!GrowArray((void**)&pool->slots, sizeof(*pool->slots), capacity)) {
+        return false;
+    }
+    pool->slot_capacity = capacity;
+    return true;
+}
+
+bool BH_InitEntities(struct BH_EntityPool* pool, size_t capacity) {
+    memset(pool, 0, sizeof(*pool));
+    pool->free_slot = NO_FREE_SLOT;
+
+    if (capacity == 0) {
+        capacity = ENTITIES_START_CAPACITY;
+    }
+
+    if (!ReserveEntities(pool, capacity) || !ReserveSlots(pool, capacity)) {
+        BH_DeinitEntities(pool);
+        return false;
+    }
+
+    return true;
+}
+
+void BH_DeinitEntities(struct BH_EntityPool* pool) {
+    for (size_t i = 0; i < pool->slot_count; i++) {
+        free(pool->slots[i].state);
+    }
+
+#define FREE_FIELD(field) free(pool->field);
+    ENTITY_FIELDS(FREE_FIELD)
+#undef FREE_FIELD
+    free(pool->slots);
+    free(pool->despawn_queue);
+    free(pool->groups);
+
+    memset(pool, 0, sizeof(*pool));
+}
+
+static bool AllocateSlot(struct BH_EntityPool* pool, uint32_t* slot) {
+    if (pool->free_slot != NO_FREE_SLOT) {
+        *slot = pool->free_slot;
+        pool->free_slot = pool->slots[*slot].dense;
+        return true;
+    }
+
+    if (pool->slot_count >= NO_FREE_SLOT) {
+        error("Entity slots exhausted");
+        return false;
+    }
+
+    if (!ReserveSlots(pool, GrownCapacity(pool->slot_capacity, pool->slot_count + 1))) {
+        return false;
+    }
+
+    *slot = (uint32_t)pool->slot_count++;
+    pool->slots[*slot] = (struct BH_EntitySlot){ .generation = 1 };
+
+    return true;
+}
+
+static void ReleaseSlot(struct BH_EntityPool* pool, uint32_t slot) {
+    /* Invalidate outstanding handles, skipping 0 on wrap-around */
+    if (++pool->slots[slot].generation == 0) {
+        pool->slots[slot].generation = 1;
+    }
+    pool->slots[slot].dense = pool->free_slot;
+    pool->free_slot = slot;
+}
+
+static void*
+AcquireState(struct BH_EntityPool* pool, uint32_t slot, const void* state, size_t size) {
+    struct BH_EntitySlot* s = &pool->slots[slot];
+
+    if (size == 0) {
+        return NULL;
+    }
+
+    if (s->state_capacity < size) {
+        void* block = realloc(s->state, size);
+        if (block == NULL) {
+            error("Failed to allocate memory");
+            return NULL;
+        }
+        s->state = block;
+        s->state_capacity = size;
+    }
+
+    if (state) {
+        memcpy(s->state, state, size);
+    } else {
+        memset(s->state, 0, size);
+    }
+
+    return s->state;
+}
+
+bool BH_ReserveEntities(struct BH_EntityPool* pool, size_t count) {
+    /* Each live entity holds one slot, so `count` slots always suffice */
+    return ReserveEntities(pool, GrownCapacity(pool->capacity, count)) &&
+           ReserveSlots(pool, GrownCapacity(pool->slot_capacity, count));
+}
+
+/* Appends `entity` to the dense arrays, which must have room for it */
+static bool PushEntity(struct BH_EntityPool* pool, const struct BH_SpriteEntity* entity) {
+    uint32_t slot;
+    if (!AllocateSlot(pool, &slot)) {
+        return false;
+    }
+
+    void* state = AcquireState(pool, slot, entity->state, entity->state_size);
+    if (entity->state_size && state == NULL) {
+        ReleaseSlot(pool, slot);
+        return false;
+    }
+
+    size_t i = pool->count++;
+
+    pool->sprites[i] = entity->sprite;
+    pool->positions[i] = entity->position;
+    pool->scales[i] = entity->scale;
+    pool->rotations[i] = entity->rotation;
+    pool->depths[i] = entity->depth;
+    pool->bbs[i] = entity->bb;
+    pool->shapes[i] = entity->shape;
+    pool->types[i] = entity->type;
+    pool->components[i] = entity->components;
+    pool->layers[i] = entity->layer;
+    pool->masks[i] = entity->mask;
+
+    struct BH_Motion motion = { 0 };
+    if (entity->components & BH_COMPONENT_MOTION) {
+        motion = entity->motion;
+    }
+    pool->velocities[i] = motion.velocity;
+    pool->accelerations[i] = motion.acceleration;
+    pool->angular_velocities[i] = motion.angular_velocity;
+    pool->max_speeds[i] = motion.max_speed > 0.0f ? motion.max_speed : FLT_MAX;
+
+    /* NAN never compares equal, forcing the first sin/cos */
+    pool->dirty[i] = 1;
+    pool->cached_rotations[i] = NAN;
+
+    pool->callbacks[i] = entity->callback;
+    pool->states[i] = state;
+    pool->slot_indices[i] = slot;
+
+    pool->slots[slot].dense = (uint32_t)i;
+
+    return true;
+}
+
+struct BH_EntityHandle BH_SpawnEntity(struct BH_EntityPool* pool, struct BH_SpriteEntity entity) {
+    if (!BH_ReserveEntities(pool, pool->count + 1) || !PushEntity(pool, &entity)) {
+        return (struct BH_EntityHandle){ 0 };
+    }
+    return BH_EntityHandleAt(pool, pool->count - 1);
+}
+
+size_t BH_SpawnEntities(
+    struct BH_EntityPool* pool, const struct BH_SpriteEntity* entity, size_t count, size_t* first
+) {
+    *first = pool->count;
+
+    if (!BH_ReserveEntities(pool, pool->count + count)) {
+        return 0;
+    }
+
+    size_t spawned = 0;
+    while (spawned < count && PushEntity(pool, entity)) {
+        spawned++;
+    }
+
+    return spawned;
+}
+
+void BH_DespawnEntity(struct BH_EntityPool* pool, struct BH_EntityHandle handle) {
+    if (pool->despawn_count >= pool->despawn_capacity) {
+        size_t capacity = GrownCapacity(pool->despawn_capacity, pool->despawn_count + 1);
+        if (!GrowArray((void**)&pool->despawn_queue, sizeof(*pool->despawn_queue), capacity)) {
+            return;
+        }
+        pool->despawn_capacity = capacity;
+    }
+
+    pool->despawn_queue[pool->despawn_count++] = handle;
+}
+
+static void MoveEntity(struct BH_EntityPool* pool, size_t dst, size_t src) {
+    if (dst == src) {
+        return;
+    }
+
+#define MOVE_FIELD(field) pool->field[dst] = pool->field[src];
+    ENTITY_FIELDS(MOVE_FIELD)
+#undef MOVE_FIELD
+
+    pool->slots[pool->slot_indices[dst]].dense = (uint32_t)dst;
+}
+
+static void SwapBytes(void* a, void* b, size_t size) {
+    unsigned char* x = a;
+    unsigned char* y = b;
+    for (size_t i = 0; i < size; i++) {
+        unsigned char t = x[i];
+        x[i] = y[i];
+        y[i] = t;
+    }
+}
+
+static void SwapEntities(struct BH_EntityPool* pool, size_t a, size_t b) {
+    if (a == b) {
+        return;
+    }
+
+#define SWAP_FIELD(field) SwapBytes(&pool->field[a], &pool->field[b], sizeof(*pool->field));
+    ENTITY_FIELDS(SWAP_FIELD)
+#undef SWAP_FIELD
+
+    pool->slots[pool->slot_indices[a]].dense = (uint32_t)a;
+    pool->slots[pool->slot_indices[b]].dense = (uint32_t)b;
+}
+
+static size_t GroupOf(const struct BH_EntityPool* pool, size_t entity) {
+    size_t g = 0;
+    while (entity >= pool->groups[g].begin + pool->groups[g].count) {
+        g++;
+    }
+    return g;
+}
+
+/* Removes `entity` while keeping the groups contiguous: the hole is moved
+ * to the end of its group, then through every later group by moving each
+ * group's last entity into the slot just before it, and finally filled
+ * from the ungrouped tail. */
+static void RemoveEntity(struct BH_EntityPool* pool, size_t entity) {
+    size_t hole = entity;
+
+    if (entity < pool->grouped_count) {
+        size_t g = GroupOf(pool, entity);
+
+        struct BH_EntityGroup* group = &pool->groups[g];
+        size_t last = group->begin + group->count - 1;
+        MoveEntity(pool, hole, last);
+        hole = last;
+        group->count--;
+
+        for (g++; g < pool->group_count; g++) {
+            group = &pool->groups[g];
+            if (group->count > 0) {
+                last = group->begin + group->count - 1;
+                MoveEntity(pool, hole, last);
+                hole = last;
+            }
+            group->begin--;
+        }
+
+        pool->grouped_count--;
+    }
+
+    MoveEntity(pool, hole, pool->count - 1);
+    pool->count--;
+}
+
+void BH_FlushDespawns(struct BH_EntityPool* pool) {
+    for (size_t i = 0; i < pool->despawn_count; i++) {
+        struct BH_EntityHandle handle = pool->despawn_queue[i];
+
+        /* Duplicates fail here, as the first removal bumps the generation */
+        size_t entity = BH_EntityIndex(pool, handle);
+        if (entity == BH_INVALID_ENTITY) {
+            continue;
+        }
+
+        RemoveEntity(pool, entity);
+        ReleaseSlot(pool, handle.index);
+    }
+
+    pool->despawn_count = 0;
+}
+
+static size_t FindGroup(struct BH_EntityPool* pool, enum BH_EntityType type, uint32_t components) {
+    for (size_t g = 0; g < pool->group_count; g++) {
+        if (pool->groups[g].type == type && pool->groups[g].components == components) {
+            return g;
+        }
+    }
+
+    if (pool->group_count >= pool->group_capacity) {
+        size_t capacity = GrownCapacity(pool->group_capacity, pool->group_count + 1);
+        if (!GrowArray((void**)&pool->groups, sizeof(*pool->groups), capacity)) {
+            return SIZE_MAX;
+        }
+        pool->group_capacity = capacity;
+    }
+
+    pool->groups[pool->group_count] = (struct BH_EntityGroup){
+        .type = type,
+        .components = components,
+        .begin = pool->grouped_count,
+        .count = 0,
+    };
+
+    return pool->group_count++;
+}
+
+/* The mirror image of RemoveEntity: the first tail entity is swapped
+ * backwards through the later groups, each of which shifts by one. */
+static bool GroupEntity(struct BH_EntityPool* pool) {
+    size_t entity = pool->grouped_count;
+
+    size_t g = FindGroup(pool, pool->types[entity], pool->components[entity]);
+    if (g == SIZE_MAX) {
+        return false;
+    }
+
+    for (size_t h = pool->group_count - 1; h > g; h--) {
+        struct BH_EntityGroup* group = &pool->groups[h];
+        SwapEntities(pool, entity, group->begin);
+        entity = group->begin;
+        group->begin++;
+    }
+
+    pool->groups[g].count++;
+    pool->grouped_count++;
+
+    return true;
+}
+
+void BH_FlushSpawns(struct BH_EntityPool* pool) {
+    while (pool->grouped_count < pool->count) {
+        if (!GroupEntity(pool)) {
+            return;
+        }
+    }
+}
+
+struct BH_EntityHandle BH_EntityHandleAt(const struct BH_EntityPool* pool, size_t entity) {
+    uint32_t slot = pool->slot_indices[entity];
+    return (struct BH_EntityHandle){ .index = slot, .generation = pool->slots[slot].generation };
+}
+
+size_t BH_EntityIndex(const struct BH_EntityPool* pool, struct BH_EntityHandle handle) {
+    if (handle.index >= pool->slot_count) {
+        return BH_INVALID_ENTITY;
+    }
+
+    struct BH_EntitySlot slot = pool->slots[handle.index];
+    if (slot.generation != handle.generation) {
+        return BH_INVALID_ENTITY;
+    }
+
+    return slot.dense;
+}
+
+bool BH_IsEntityAlive(const struct BH_EntityPool* pool, struct BH_EntityHandle handle) {
+    return BH_EntityIndex(pool, handle) != BH_INVALID_ENTITY;
+}
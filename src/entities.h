@@ -0,0 +1,105 @@
+#pragma once
+
+#include "entitydef.h"
+#include "matrix.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BH_INVALID_ENTITY SIZE_MAX
+
+/* A free slot reuses `dense` as the index of the next free slot. The state
+ * block stays with the slot, so respawning into it does not allocate. */
+struct BH_EntitySlot {
+    uint32_t dense;
+    uint32_t generation;
+    void* state;
+    size_t state_capacity;
+};
+
+/* A contiguous run of entities sharing a type and component mask */
+struct BH_EntityGroup {
+    enum BH_EntityType type;
+    uint32_t components;
+    size_t begin;
+    size_t count;
+};
+
+/* Entities are stored densely, one array per field, so that every system
+ * walks memory linearly. Index `i` is valid for `i < count`. Handles go
+ * through `slots`, which map a handle index to the current dense index.
+ *
+ * Dense indices [0, grouped_count) are partitioned into `groups`. Spawned
+ * entities are appended to [grouped_count, count) and join their group in
+ * BH_FlushSpawns, so dense indices only change at the end of a tick. */
+struct BH_EntityPool {
+    struct BH_Sprite* sprites;
+    struct vec2* positions;
+    struct vec2* scales;
+    float* rotations;
+    float* depths;
+    struct BH_BB* bbs;
+    struct BH_Shape* shapes; /* see shapes.h */
+    enum BH_EntityType* types;
+    uint32_t* components;
+    uint32_t* layers; /* see collision.h */
+    uint32_t* masks;
+
+    /* Motion component. Entities without BH_COMPONENT_MOTION keep these
+     * zeroed, which makes integrating them a no-op. */
+    struct vec2* velocities;
+    struct vec2* accelerations;
+    float* angular_velocities;
+    float* max_speeds;
+
+    /* Set when the transform inputs may have changed, see transform.h */
+    uint8_t* dirty;
+    float* cached_rotations;
+
+    BH_SpriteEntityCB* callbacks;
+    void** states;
+    uint32_t* slot_indices; /* dense index -> slot */
+
+    size_t count;
+    size_t capacity;
+
+    struct BH_EntitySlot* slots;
+    size_t slot_count;
+    size_t slot_capacity;
+    uint32_t free_slot;
+
+    struct BH_EntityHandle* despawn_queue;
+    size_t despawn_count;
+    size_t despawn_capacity;
+
+    struct BH_EntityGroup* groups;
+    size_t group_count;
+    size_t group_capacity;
+    size_t grouped_count;
+};
+
+bool BH_InitEntities(struct BH_EntityPool* pool, size_t capacity);
+void BH_DeinitEntities(struct BH_EntityPool* pool);
+
+/* Makes room for `count` entities in total */
+bool BH_ReserveEntities(struct BH_EntityPool* pool, size_t count);
+
+struct BH_EntityHandle BH_SpawnEntity(struct BH_EntityPool* pool, struct BH_SpriteEntity entity);
+/* Spawns `count` copies of `entity` with a single reservation. They occupy
+ * the dense indices starting at `*first`. Returns how many were spawned. */
+size_t BH_SpawnEntities(
+    struct BH_EntityPool* pool, const struct BH_SpriteEntity* entity, size_t count, size_t* first
+);
+
+/* Queues the entity for removal. Safe to call from a `BH_SpriteEntityCB`;
+ * the entity stays in place until `BH_FlushDespawns` runs at the end of the
+ * tick. Despawning a stale handle or despawning twice is harmless. */
+void BH_DespawnEntity(struct BH_EntityPool* pool, struct BH_EntityHandle handle);
+void BH_FlushDespawns(struct BH_EntityPool* pool);
+/* Moves newly spawned entities into their groups */
+void BH_FlushSpawns(struct BH_EntityPool* pool);
+
+struct BH_EntityHandle BH_EntityHandleAt(const struct BH_EntityPool* pool, size_t entity);
+/* Returns BH_INVALID_ENTITY if the handle is stale */
+size_t BH_EntityIndex(const struct BH_EntityPool* pool, struct BH_EntityHandle handle);
+bool BH_IsEntityAlive(const struct BH_EntityPool* pool, struct BH_EntityHandle handle);
@@ -2,20 +2,37 @@
 
 #include "matrix.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct BH_Context;
-struct BH_SpriteEntity;
-typedef void (*BH_SpriteEntityCB)(struct BH_Context* state, struct BH_SpriteEntity* entity);
+
+/* `entity` is the entity's index into the dense arrays of `state->entities`.
+ * It stays valid for the duration of the callback. */
+typedef void (*BH_SpriteEntityCB)(struct BH_Context* state, size_t entity);
+
+/* Stable reference to an entity. `generation` starts at 1, so a zeroed
+ * handle never refers to a live entity. */
+struct BH_EntityHandle {
+    uint32_t index;
+    uint32_t generation;
+};
 
 struct BH_Colour {
     float r, g, b, a;
 };
 
+/* One sprite exactly as it is uploaded, 32 bytes. vertex.glsl builds the
+ * model matrix from it, so the layout must match `struct sprite` there.
+ * For entities, everything up to `depth` is filled in from the pool. */
 struct BH_Sprite {
-    m4 transform;
-    GLuint64 texture_handle;
-    GLuint flags;
-    struct BH_Colour colour;
+    struct vec2 position;
+    struct vec2 half_size;
+    uint32_t rotation; /* cosine and sine, see pack_snorm2x16 */
+    float depth;
+    uint32_t colour;   /* see BH_PackColour */
+    uint16_t texture;  /* region from BH_GetAtlasRegion or BH_LoadTexture */
+    uint16_t flags;    /* enum BH_SpriteFlag */
 };
 
 struct BH_BB {
@@ -23,11 +40,45 @@ struct BH_BB {
     struct vec2 bottom_right;
 };
 
+enum BH_ShapeType {
+    BH_SHAPE_BOX = 0, /* the entity's `bb` */
+    BH_SHAPE_CIRCLE,  /* `radius` around `a` */
+    BH_SHAPE_CAPSULE, /* `radius` around the segment from `a` to `b` */
+};
+
+/* Exact hitbox for the narrow phase, see shapes.h. Relative to the
+ * entity's position like `bb`, which must contain it, and not turned by
+ * its rotation. */
+struct BH_Shape {
+    enum BH_ShapeType type;
+    struct vec2 a;
+    struct vec2 b;
+    float radius;
+};
+
 enum BH_EntityType {
     BH_BULLET = 0,
     BH_PLAYER,
+    /* Games may use values from here on for their own types */
+    BH_USER_TYPE,
+};
+
+enum BH_Component {
+    /* Integrated by the engine every tick, see motion.h */
+    BH_COMPONENT_MOTION = 1 << 0,
+};
+
+struct BH_Motion {
+    struct vec2 velocity;
+    struct vec2 acceleration;
+    /* Turns both the velocity and the sprite, in radians per second */
+    float angular_velocity;
+    /* 0 means uncapped */
+    float max_speed;
 };
 
+/* Spawn description of an entity, see `BH_SpawnEntity`. Once spawned,
+ * its fields live in the arrays of a `struct BH_EntityPool`. */
 struct BH_SpriteEntity {
     struct BH_Sprite sprite;
 
@@ -37,8 +88,25 @@ struct BH_SpriteEntity {
     float depth;
 
     struct BH_BB bb;
+    /* Zeroed, this is the box itself */
+    struct BH_Shape shape;
 
     enum BH_EntityType type;
+    uint32_t components;
+    struct BH_Motion motion;
+
+    /* Bitfields of the collision layers the entity is on and of those it
+     * collides with, see collision.h. Both 0 for entities that never
+     * collide. */
+    uint32_t layer;
+    uint32_t mask;
+
+    /* Only for entities that need custom logic, plain bullets should use
+     * BH_COMPONENT_MOTION instead */
     BH_SpriteEntityCB callback;
-    void* state;
+
+    /* Initial contents of the entity's state block. The pool copies
+     * `state_size` bytes into a block it owns and recycles. */
+    const void* state;
+    size_t state_size;
 };
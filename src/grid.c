@@ -0,0 +1,525 @@
+#include "grid.h"
+#include "error_macro.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRID_START_CAPACITY 256
+#define GRID_GROW_FACTOR 2
+
+/* Cell coordinates are clamped to this, far enough out that only entities
+ * already lost to float precision share the edge cells */
+#define CELL_LIMIT (1 << 24)
+/* Fitted cells are never smaller than this, in world units */
+#define MIN_CELL_SIZE 1.0f
+
+bool BH_InitGrid(struct BH_Grid* grid, float cell_size) {
+    if (!(cell_size >= 0.0f) || isinf(cell_size)) {
+        error("Invalid grid cell size %f", cell_size);
+        return false;
+    }
+
+    *grid = (struct BH_Grid){
+        .cell_size = cell_size > 0.0f ? cell_size : MIN_CELL_SIZE,
+        .fit_cell_size = cell_size == 0.0f,
+    };
+
+    return true;
+}
+
+void BH_ClearGrid(struct BH_Grid* grid) {
+    grid->count = 0;
+    grid->bucket_count = 0;
+    grid->large_count = 0;
+}
+
+static bool GrowEntities(struct BH_Grid* grid) {
+    size_t capacity = grid->capacity ? grid->capacity * GRID_GROW_FACTOR : GRID_START_CAPACITY;
+
+    struct BH_SpatialEntity* entities =
+        realloc(grid->entities, capacity * sizeof(struct BH_SpatialEntity));
+    if (entities != NULL) {
+        grid->entities = entities;
+    }
+    uint32_t* stamps = realloc(grid->stamps, capacity * sizeof(uint32_t));
+    if (stamps != NULL) {
+        grid->stamps = stamps;
+    }
+    uint32_t* large = realloc(grid->large, capacity * sizeof(uint32_t));
+    if (large != NULL) {
+        grid->large = large;
+    }
+
+    if (entities == NULL || stamps == NULL || large == NULL) {
+        error("Failed to allocate memory");
+        return false;
+    }
+
+    grid->capacity = capacity;
+    return true;
+}
+
+bool BH_InsertGrid(struct BH_Grid* grid, struct BH_SpatialEntity entity) {
+    if (grid->count >= grid->capacity && !GrowEntities(grid)) {
+        return false;
+    }
+
+    grid->entities[grid->count] = entity;
+    grid->stamps[grid->count] = 0;
+    grid->count++;
+
+    return true;
+}
+
+static int32_t CellCoord(float value, float cell_size) {
+    float cell = floorf(value / cell_size);
+    /* Also catches NaN */
+    if (!(cell >= -CELL_LIMIT)) {
+        return isnan(cell) ? 0 : -CELL_LIMIT;
+    }
+    if (cell > CELL_LIMIT) {
+        return CELL_LIMIT;
+    }
+    return (int32_t)cell;
+}
+
+static struct BH_CellRange CellsOf(const struct BH_Grid* grid, struct BH_BB bb) {
+    return (struct BH_CellRange){
+        .x0 = CellCoord(bb.top_left.x, grid->cell_size),
+        .y0 = CellCoord(bb.top_left.y, grid->cell_size),
+        .x1 = CellCoord(bb.bottom_right.x, grid->cell_size),
+        .y1 = CellCoord(bb.bottom_right.y, grid->cell_size),
+    };
+}
+
+/* 0 for inverted boxes */
+static uint64_t CountCells(struct BH_CellRange range) {
+    if (range.x1 < range.x0 || range.y1 < range.y0) {
+        return 0;
+    }
+    return (uint64_t)(range.x1 - range.x0 + 1) * (uint64_t)(range.y1 - range.y0 + 1);
+}
+
+/* Inverted boxes still pass BH_DoBoxesIntersect against some boxes, so they
+ * are kept with the large ones rather than in no cell at all */
+static bool IsLarge(struct BH_CellRange range) {
+    uint64_t cells = CountCells(range);
+    return cells == 0 || cells > BH_GRID_MAX_CELLS;
+}
+
+static size_t Bucket(const struct BH_Grid* grid, int32_t x, int32_t y) {
+    uint32_t hash = (uint32_t)x * 0x9e3779b1u ^ (uint32_t)y * 0x85ebca77u;
+    hash ^= hash >> 16;
+    return hash & (grid->bucket_count - 1);
+}
+
+/* Cells end up BH_GRID_CELL_SCALE times the average entity across, so most
+ * entities touch at most four of them */
+static void FitCellSize(struct BH_Grid* grid) {
+    double total = 0.0;
+    size_t sized = 0;
+
+    for (size_t i = 0; i < grid->count; i++) {
+        struct vec2 size = BH_BoxDimensions(grid->entities[i].bb);
+        float extent = fmaxf(size.x, size.y);
+        if (extent > 0.0f && isfinite(extent)) {
+            total += extent;
+            sized++;
+        }
+    }
+
+    if (sized == 0) {
+        return;
+    }
+
+    float cell_size = (float)(total / sized) * BH_GRID_CELL_SCALE;
+    grid->cell_size = fmaxf(cell_size, MIN_CELL_SIZE);
+}
+
+static bool Reserve(uint32_t** array, size_t* capacity, size_t count) {
+    if (count <= *capacity) {
+        return true;
+    }
+
+    size_t grown = *capacity ? *capacity : GRID_START_CAPACITY;
+    while (grown < count) {
+        grown *= GRID_GROW_FACTOR;
+    }
+
+    uint32_t* data = realloc(*array, grown * sizeof(uint32_t));
+    if (data == NULL) {
+        error("Failed to allocate memory");
+        return false;
+    }
+
+    *array = data;
+    *capacity = grown;
+    return true;
+}
+
+bool BH_BuildGrid(struct BH_Grid* grid) {
+    if (grid->fit_cell_size) {
+        FitCellSize(grid);
+    }
+
+    grid->bucket_count = 0;
+    grid->large_count = 0;
+    grid->occupied = (struct BH_CellRange){ INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+
+    size_t ref_count = 0;
+    for (size_t i = 0; i < grid->count; i++) {
+        struct BH_CellRange range = CellsOf(grid, grid->entities[i].bb);
+        if (IsLarge(range)) {
+            grid->large[grid->large_count++] = i;
+            continue;
+        }
+
+        ref_count += CountCells(range);
+        grid->occupied.x0 = range.x0 < grid->occupied.x0 ? range.x0 : grid->occupied.x0;
+        grid->occupied.y0 = range.y0 < grid->occupied.y0 ? range.y0 : grid->occupied.y0;
+        grid->occupied.x1 = range.x1 > grid->occupied.x1 ? range.x1 : grid->occupied.x1;
+        grid->occupied.y1 = range.y1 > grid->occupied.y1 ? range.y1 : grid->occupied.y1;
+    }
+
+    /* About one reference per bucket */
+    size_t bucket_count = 1;
+    while (bucket_count < ref_count) {
+        bucket_count *= 2;
+    }
+
+    if (!Reserve(&grid->buckets, &grid->bucket_capacity, bucket_count + 1) ||
+        !Reserve(&grid->refs, &grid->ref_capacity, ref_count)) {
+        return false;
+    }
+
+    grid->bucket_count = bucket_count;
+    memset(grid->buckets, 0, (bucket_count + 1) * sizeof(uint32_t));
+
+    /* Count each bucket's references one slot up, so the prefix sum leaves
+     * every bucket with its start */
+    for (size_t i = 0; i < grid->count; i++) {
+        struct BH_CellRange range = CellsOf(grid, grid->entities[i].bb);
+        if (IsLarge(range)) {
+            continue;
+        }
+
+        for (int32_t y = range.y0; y <= range.y1; y++) {
+            for (int32_t x = range.x0; x <= range.x1; x++) {
+                grid->buckets[Bucket(grid, x, y) + 1]++;
+            }
+        }
+    }
+
+    for (size_t b = 1; b <= bucket_count; b++) {
+        grid->buckets[b] += grid->buckets[b - 1];
+    }
+
+    /* Filling moves every start up to the end of its bucket... */
+    for (size_t i = 0; i < grid->count; i++) {
+        struct BH_CellRange range = CellsOf(grid, grid->entities[i].bb);
+        if (IsLarge(range)) {
+            continue;
+        }
+
+        for (int32_t y = range.y0; y <= range.y1; y++) {
+            for (int32_t x = range.x0; x <= range.x1; x++) {
+                grid->refs[grid->buckets[Bucket(grid, x, y)]++] = i;
+            }
+        }
+    }
+
+    /* ...which is the start of the next one */
+    for (size_t b = bucket_count; b-- > 1;) {
+        grid->buckets[b] = grid->buckets[b - 1];
+    }
+    grid->buckets[0] = 0;
+
+    return true;
+}
+
+static void NextStamp(struct BH_Grid* grid) {
+    grid->stamp++;
+    if (grid->stamp == 0) {
+        memset(grid->stamps, 0, grid->count * sizeof(uint32_t));
+        grid->stamp = 1;
+    }
+}
+
+bool BH_VisitGrid(struct BH_Grid* grid, struct BH_BB box, BH_SpatialVisitCB visit, void* data) {
+    if (grid->bucket_count == 0) {
+        return true;
+    }
+
+    /* Past as many cells as there are entities, going through every entity
+     * is quicker. Inverted boxes have no cells to go through. */
+    struct BH_CellRange range = CellsOf(grid, box);
+    uint64_t cells = CountCells(range);
+    if (cells == 0 || cells > grid->count) {
+        for (size_t i = 0; i < grid->count; i++) {
+            if (BH_DoBoxesIntersect(box, grid->entities[i].bb) &&
+                !visit(&grid->entities[i], data)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* Entities covering several cells, or sharing a bucket with themselves,
+     * are referenced more than once */
+    NextStamp(grid);
+
+    for (int32_t y = range.y0; y <= range.y1; y++) {
+        for (int32_t x = range.x0; x <= range.x1; x++) {
+            size_t bucket = Bucket(grid, x, y);
+
+            for (uint32_t r = grid->buckets[bucket]; r < grid->buckets[bucket + 1]; r++) {
+                uint32_t i = grid->refs[r];
+                if (grid->stamps[i] == grid->stamp) {
+                    continue;
+                }
+                grid->stamps[i] = grid->stamp;
+
+                if (BH_DoBoxesIntersect(box, grid->entities[i].bb) &&
+                    !visit(&grid->entities[i], data)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    for (size_t l = 0; l < grid->large_count; l++) {
+        uint32_t i = grid->large[l];
+        if (BH_DoBoxesIntersect(box, grid->entities[i].bb) && !visit(&grid->entities[i], data)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Offers the entities of a cell that have not been offered yet. Returns
+ * false once the search has looked at more cells than there are entities,
+ * at which point going through all of them is quicker. */
+static bool OfferCell(
+    struct BH_Grid* grid, int32_t x, int32_t y, size_t* cells, void (*offer)(void*, size_t),
+    void* search
+) {
+    if (++*cells > grid->count) {
+        return false;
+    }
+
+    size_t bucket = Bucket(grid, x, y);
+    for (uint32_t r = grid->buckets[bucket]; r < grid->buckets[bucket + 1]; r++) {
+        uint32_t i = grid->refs[r];
+        if (grid->stamps[i] != grid->stamp) {
+            grid->stamps[i] = grid->stamp;
+            offer(search, i);
+        }
+    }
+
+    return true;
+}
+
+/* Offers every entity not offered yet */
+static void OfferRest(struct BH_Grid* grid, void (*offer)(void*, size_t), void* search) {
+    for (size_t i = 0; i < grid->count; i++) {
+        if (grid->stamps[i] != grid->stamp) {
+            grid->stamps[i] = grid->stamp;
+            offer(search, i);
+        }
+    }
+}
+
+struct GridSearch {
+    struct BH_Grid* grid;
+    void* search;
+};
+
+static void OfferNearest(void* data, size_t entity) {
+    struct GridSearch* search = data;
+    BH_OfferNearest(search->search, &search->grid->entities[entity]);
+}
+
+static void OfferRay(void* data, size_t entity) {
+    struct GridSearch* search = data;
+    BH_OfferRay(search->search, &search->grid->entities[entity]);
+}
+
+static int64_t MaxInt64(int64_t a, int64_t b) { return a > b ? a : b; }
+static int64_t MinInt64(int64_t a, int64_t b) { return a < b ? a : b; }
+
+/* Visits the cells exactly `ring` cells from (x, y) that are occupied */
+static bool OfferRing(
+    struct BH_Grid* grid, int64_t x, int64_t y, int64_t ring, size_t* cells,
+    struct GridSearch* search
+) {
+    struct BH_CellRange occupied = grid->occupied;
+    int64_t y0 = MaxInt64(y - ring, occupied.y0);
+    int64_t y1 = MinInt64(y + ring, occupied.y1);
+
+    for (int64_t row = y0; row <= y1; row++) {
+        if (row == y - ring || row == y + ring) {
+            int64_t x0 = MaxInt64(x - ring, occupied.x0);
+            int64_t x1 = MinInt64(x + ring, occupied.x1);
+            for (int64_t column = x0; column <= x1; column++) {
+                if (!OfferCell(grid, column, row, cells, OfferNearest, search)) {
+                    return false;
+                }
+            }
+            continue;
+        }
+
+        if (x - ring >= occupied.x0 &&
+            !OfferCell(grid, x - ring, row, cells, OfferNearest, search)) {
+            return false;
+        }
+        if (x + ring <= occupied.x1 &&
+            !OfferCell(grid, x + ring, row, cells, OfferNearest, search)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void BH_KNearestGrid(struct BH_Grid* grid, struct BH_NearestSearch* search) {
+    if (grid->bucket_count == 0 || search->k == 0) {
+        return;
+    }
+
+    struct GridSearch grid_search = { .grid = grid, .search = search };
+    NextStamp(grid);
+
+    for (size_t l = 0; l < grid->large_count; l++) {
+        grid->stamps[grid->large[l]] = grid->stamp;
+        BH_OfferNearest(search, &grid->entities[grid->large[l]]);
+    }
+
+    struct BH_CellRange occupied = grid->occupied;
+    if (occupied.x1 < occupied.x0) {
+        return;
+    }
+
+    int64_t x = CellCoord(search->point.x, grid->cell_size);
+    int64_t y = CellCoord(search->point.y, grid->cell_size);
+
+    /* Rings are only a bound on distance where cells are not clamped */
+    if (llabs(x) >= CELL_LIMIT || llabs(y) >= CELL_LIMIT) {
+        OfferRest(grid, OfferNearest, &grid_search);
+        return;
+    }
+
+    /* From the first ring that reaches the occupied cells to the first that
+     * covers them all */
+    int64_t first = MaxInt64(
+        MaxInt64(occupied.x0 - x, x - occupied.x1), MaxInt64(occupied.y0 - y, y - occupied.y1)
+    );
+    int64_t last = MaxInt64(
+        MaxInt64(x - occupied.x0, occupied.x1 - x), MaxInt64(y - occupied.y0, occupied.y1 - y)
+    );
+
+    size_t cells = 0;
+    for (int64_t ring = MaxInt64(first, 0); ring <= last; ring++) {
+        /* Everything in this ring and beyond is at least a ring less away */
+        if ((float)(ring - 1) * grid->cell_size > BH_NearestBound(search)) {
+            return;
+        }
+
+        if (!OfferRing(grid, x, y, ring, &cells, &grid_search)) {
+            OfferRest(grid, OfferNearest, &grid_search);
+            return;
+        }
+    }
+}
+
+void BH_RaycastGrid(struct BH_Grid* grid, struct BH_RaySearch* search) {
+    if (grid->bucket_count == 0) {
+        return;
+    }
+
+    struct GridSearch grid_search = { .grid = grid, .search = search };
+    NextStamp(grid);
+
+    for (size_t l = 0; l < grid->large_count; l++) {
+        grid->stamps[grid->large[l]] = grid->stamp;
+        BH_OfferRay(search, &grid->entities[grid->large[l]]);
+    }
+
+    struct BH_CellRange occupied = grid->occupied;
+    if (occupied.x1 < occupied.x0) {
+        return;
+    }
+
+    /* Only the part of the ray over the occupied cells matters */
+    float size = grid->cell_size;
+    struct BH_BB bounds = {
+        .top_left = { (float)occupied.x0 * size, (float)occupied.y0 * size },
+        .bottom_right = { (float)(occupied.x1 + 1) * size, (float)(occupied.y1 + 1) * size },
+    };
+    float enter;
+    if (!BH_RayHitsBox(search->origin, search->direction, bounds, search->max_distance, &enter)) {
+        return;
+    }
+
+    struct vec2 start = {
+        search->origin.x + search->direction.x * enter,
+        search->origin.y + search->direction.y * enter,
+    };
+    int64_t x = MinInt64(MaxInt64(CellCoord(start.x, size), occupied.x0), occupied.x1);
+    int64_t y = MinInt64(MaxInt64(CellCoord(start.y, size), occupied.y0), occupied.y1);
+
+    /* Amanatides and Woo: `next` is how far along the ray the next column
+     * or row starts, `step` how far apart they are */
+    struct vec2 direction = search->direction;
+    int64_t step_x = direction.x > 0.0f ? 1 : -1;
+    int64_t step_y = direction.y > 0.0f ? 1 : -1;
+    float next_x = INFINITY, next_y = INFINITY;
+    float delta_x = INFINITY, delta_y = INFINITY;
+
+    if (direction.x != 0.0f) {
+        float edge = (float)(step_x > 0 ? x + 1 : x) * size;
+        next_x = enter + (edge - start.x) / direction.x;
+        delta_x = size / fabsf(direction.x);
+    }
+    if (direction.y != 0.0f) {
+        float edge = (float)(step_y > 0 ? y + 1 : y) * size;
+        next_y = enter + (edge - start.y) / direction.y;
+        delta_y = size / fabsf(direction.y);
+    }
+
+    size_t cells = 0;
+    for (;;) {
+        if (!OfferCell(grid, x, y, &cells, OfferRay, &grid_search)) {
+            OfferRest(grid, OfferRay, &grid_search);
+            return;
+        }
+
+        /* Entities in later cells are entered no earlier than this one is
+         * left, apart from the ones already offered */
+        float exit = fminf(next_x, next_y);
+        if (exit >= search->max_distance) {
+            return;
+        }
+
+        if (next_x < next_y) {
+            x += step_x;
+            next_x += delta_x;
+        } else {
+            y += step_y;
+            next_y += delta_y;
+        }
+
+        if (x < occupied.x0 || x > occupied.x1 || y < occupied.y0 || y > occupied.y1) {
+            return;
+        }
+    }
+}
+
+void BH_DeinitGrid(struct BH_Grid* grid) {
+    free(grid->entities);
+    free(grid->stamps);
+    free(grid->large);
+    free(grid->buckets);
+    free(grid->refs);
+    *grid = (struct BH_Grid){ 0 };
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "entitydef.h"
+#include "spatial.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Entities covering more cells than this are not put into any, but tested
+ * by every query instead */
+#define BH_GRID_MAX_CELLS 64
+/* With a fitted cell size, a cell is this many typical entities across */
+#define BH_GRID_CELL_SCALE 2.0f
+
+/* Inclusive */
+struct BH_CellRange {
+    int32_t x0, y0;
+    int32_t x1, y1;
+};
+
+/* A uniform grid with no bounds: cells are hashed into `buckets`, so only
+ * occupied ones take up any memory. Entities are inserted in any order,
+ * then BH_BuildGrid counting sorts references to them by bucket into
+ * `refs`. Hash collisions only cost a few extra box tests. All arrays are
+ * kept between builds and only ever grow, so once they are large enough,
+ * rebuilding allocates nothing. */
+struct BH_Grid {
+    float cell_size;
+    bool fit_cell_size;
+
+    struct BH_SpatialEntity* entities;
+    uint32_t* stamps; /* the last query to have seen each entity */
+    size_t count;
+    size_t capacity;
+    uint32_t stamp;
+
+    /* The references of bucket `b` are `refs[buckets[b], buckets[b + 1])` */
+    uint32_t* buckets;
+    size_t bucket_count; /* a power of two */
+    size_t bucket_capacity;
+    uint32_t* refs;
+    size_t ref_capacity;
+    /* Bounds of the cells with references in them, inverted if none do */
+    struct BH_CellRange occupied;
+
+    uint32_t* large; /* entities over BH_GRID_MAX_CELLS, as many as fit in `capacity` */
+    size_t large_count;
+};
+
+/* A `cell_size` of 0 fits it to the average entity on every build */
+bool BH_InitGrid(struct BH_Grid* grid, float cell_size);
+void BH_ClearGrid(struct BH_Grid* grid);
+bool BH_InsertGrid(struct BH_Grid* grid, struct BH_SpatialEntity entity);
+bool BH_BuildGrid(struct BH_Grid* grid);
+/* Visits the entities whose boxes overlap `box`, returns false if `visit`
+ * stopped early. Marks the entities it has seen in `stamps`, so `visit`
+ * must not query the grid again. */
+bool BH_VisitGrid(struct BH_Grid* grid, struct BH_BB box, BH_SpatialVisitCB visit, void* data);
+/* Search the rings of cells around the point, nearest first */
+void BH_KNearestGrid(struct BH_Grid* grid, struct BH_NearestSearch* search);
+/* Steps through the cells along the ray */
+void BH_RaycastGrid(struct BH_Grid* grid, struct BH_RaySearch* search);
+void BH_DeinitGrid(struct BH_Grid* grid);
@@ -0,0 +1,148 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "jobs.h"
+#include "error_macro.h"
+
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif // _WIN32
+
+#define JOBS_START_CAPACITY 64
+#define JOBS_GROW_FACTOR 2
+
+/* Called, and returns, with the lock held */
+static void RunNextJob(struct BH_JobPool* pool) {
+    struct BH_Job job = pool->jobs[pool->next++];
+    pool->running++;
+
+    pthread_mutex_unlock(&pool->lock);
+    job.callback(job.data);
+    pthread_mutex_lock(&pool->lock);
+
+    pool->running--;
+    if (pool->running == 0 && pool->next == pool->count) {
+        pool->count = 0;
+        pool->next = 0;
+        pthread_cond_broadcast(&pool->finished);
+    }
+}
+
+static void* Worker(void* data) {
+    struct BH_JobPool* pool = data;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->next == pool->count && !pool->quit) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->next == pool->count) {
+            break;
+        }
+        RunNextJob(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+size_t BH_CountJobThreads(void) {
+#ifndef _WIN32
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long cpus = info.dwNumberOfProcessors;
+#endif // _WIN32
+    return cpus > 1 ? (size_t)cpus - 1 : 0;
+}
+
+bool BH_InitJobPool(struct BH_JobPool* pool, size_t thread_count) {
+    *pool = (struct BH_JobPool){ 0 };
+
+    if (pthread_mutex_init(&pool->lock, NULL) || pthread_cond_init(&pool->work, NULL) ||
+        pthread_cond_init(&pool->finished, NULL)) {
+        error("Failed to initialise job pool");
+        return false;
+    }
+
+    if (thread_count == 0) {
+        return true;
+    }
+
+    pool->threads = malloc(thread_count * sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        error("Failed to allocate memory");
+        return false;
+    }
+
+    /* Fewer threads only make batches slower */
+    for (size_t i = 0; i < thread_count; i++) {
+        if (pthread_create(&pool->threads[pool->thread_count], NULL, Worker, pool)) {
+            error("Failed to start job thread %zu", i);
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    return true;
+}
+
+bool BH_PushJob(struct BH_JobPool* pool, BH_JobCB callback, void* data) {
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->count >= pool->capacity) {
+        size_t capacity = pool->capacity ? pool->capacity * JOBS_GROW_FACTOR : JOBS_START_CAPACITY;
+        struct BH_Job* grown = realloc(pool->jobs, capacity * sizeof(struct BH_Job));
+        if (grown == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            error("Failed to allocate memory");
+            return false;
+        }
+        pool->jobs = grown;
+        pool->capacity = capacity;
+    }
+
+    pool->jobs[pool->count++] = (struct BH_Job){ .callback = callback, .data = data };
+    pthread_cond_signal(&pool->work);
+
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+void BH_WaitJobs(struct BH_JobPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        if (pool->next < pool->count) {
+            RunNextJob(pool);
+        } else if (pool->running > 0) {
+            pthread_cond_wait(&pool->finished, &pool->lock);
+        } else {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void BH_DeinitJobPool(struct BH_JobPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->finished);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool->jobs);
+    *pool = (struct BH_JobPool){ 0 };
+}
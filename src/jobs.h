@@ -0,0 +1,42 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*BH_JobCB)(void* data);
+
+struct BH_Job {
+    BH_JobCB callback;
+    void* data;
+};
+
+/* Jobs are taken in the order they were pushed, by the workers and by
+ * whichever thread is in BH_WaitJobs. The queue is only reset once every
+ * job in it has finished, so a batch is just everything pushed before a
+ * wait. */
+struct BH_JobPool {
+    pthread_t* threads;
+    size_t thread_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;     /* jobs were pushed, or the pool is shutting down */
+    pthread_cond_t finished; /* the queue ran empty */
+
+    struct BH_Job* jobs;
+    size_t count;
+    size_t capacity;
+    size_t next;    /* first job not taken yet */
+    size_t running; /* jobs taken but not finished */
+    bool quit;
+};
+
+/* One worker per online CPU besides the calling thread, which runs jobs
+ * too while it waits on a batch. At least 0. */
+size_t BH_CountJobThreads(void);
+/* With no threads, every job runs in BH_WaitJobs */
+bool BH_InitJobPool(struct BH_JobPool* pool, size_t thread_count);
+bool BH_PushJob(struct BH_JobPool* pool, BH_JobCB callback, void* data);
+/* Helps out until all jobs pushed so far have finished */
+void BH_WaitJobs(struct BH_JobPool* pool);
+void BH_DeinitJobPool(struct BH_JobPool* pool);
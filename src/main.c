@@ -4,80 +4,155 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "../res/built_assets.h"
 #include "engine.h"
+#include "entities.h"
 #include "entitydef.h"
 #include "error_macro.h"
-#include "qtree.h"
+#include "broadphase.h"
+#include "collision.h"
 
 #define TEST_SPRITES 16
 
+#define STAR_TYPE BH_USER_TYPE
+
+enum collision_layer {
+    PLAYER_LAYER = 1 << 0,
+    ENEMY_BULLET_LAYER = 1 << 1,
+};
+
+struct game_state {
+    uint16_t star_texture;
+};
+
 static float uniform_rand(void) { return (float)rand() / (float)RAND_MAX; }
 
-static void test_entity_system(struct BH_Context* ctx, struct BH_SpriteEntity* entity) {
-    entity->position.y += 256.0f * ctx->dt;
-    if (entity->position.y >= ctx->renderer.height) {
-        entity->position.x = uniform_rand() * ctx->renderer.width;
-        entity->position.y = 0.0f;
+static void spawn_star(struct BH_Context* ctx, struct vec2 position);
+
+static void test_entity_system(struct BH_Context* ctx, struct BH_EntitySpan span) {
+    struct BH_EntityPool* entities = span.pool;
+
+    for (size_t i = span.begin; i < span.begin + span.count; i++) {
+        if (entities->positions[i].y >= ctx->renderer.height) {
+            BH_DespawnEntity(entities, BH_EntityHandleAt(entities, i));
+            spawn_star(ctx, (struct vec2){ uniform_rand() * ctx->renderer.width, 0.0f });
+        }
     }
 }
 
+static void spawn_star(struct BH_Context* ctx, struct vec2 position) {
+    struct game_state* game = ctx->user_state;
+
+    struct BH_Sprite sprite = { 0 };
+    sprite.texture = game->star_texture;
+
+    // clang-format off
+    struct BH_SpriteEntity entity = {
+        .sprite = sprite,
+        .position = position,
+        .scale = { 32.0f, 32.0f },
+        .depth = 2.0f,
+        .bb = {
+            { -12.0f, -12.0f },
+            { 12.0f, 12.0f },
+        },
+        .shape = { .type = BH_SHAPE_CIRCLE, .radius = 12.0f },
+        .type = STAR_TYPE,
+        .components = BH_COMPONENT_MOTION,
+        .motion = { .velocity = { 0.0f, 256.0f } },
+        .layer = ENEMY_BULLET_LAYER,
+    };
+    // clang-format on
+
+    BH_SpawnEntity(&ctx->entities, entity);
+}
+
 static void spawn_test_entities(struct BH_Context* ctx) {
-    GLuint64 star_texture =
-        BH_LoadTexture(&ctx->renderer.textures, (void*)ASSET_star, sizeof(ASSET_star) - 1);
-    for (size_t i = 0; i < TEST_SPRITES; i++) {
+    struct game_state* game = ctx->user_state;
+    game->star_texture = BH_GetAtlasRegion(&ctx->renderer.textures, "star");
 
-        struct BH_Sprite sprite = { 0 };
-        sprite.texture_handle = star_texture;
+    BH_RegisterSystem(
+        &ctx->systems,
+        (struct BH_System){ .callback = test_entity_system, .match_type = true, .type = STAR_TYPE }
+    );
 
-        // clang-format off
-        struct BH_SpriteEntity entity = {
-            .sprite = sprite,
-            .position = { ctx->renderer.width * uniform_rand(), ctx->renderer.height * uniform_rand() },
-            .scale = { 32.0f, 32.0f },
-            .depth = 2.0f,
-            .bb = {
-                { -12.0f, -12.0f },
-                { 12.0f, 12.0f },
-            },
-            .callback = test_entity_system,
-        };
-        // clang-format on
+    for (size_t i = 0; i < TEST_SPRITES; i++) {
+        spawn_star(
+            ctx, (struct vec2){ ctx->renderer.width * uniform_rand(),
+                                ctx->renderer.height * uniform_rand() }
+        );
+    }
+}
+
+static void offscreen_bullet_system(struct BH_Context* ctx, struct BH_EntitySpan span) {
+    struct BH_EntityPool* entities = span.pool;
+    float width = ctx->renderer.width;
+    float height = ctx->renderer.height;
 
-        BH_SpawnEntity(&ctx->entities, entity);
+    for (size_t i = span.begin; i < span.begin + span.count; i++) {
+        struct vec2 position = entities->positions[i];
+        if (position.x < 0.0f || position.x > width || position.y < 0.0f || position.y > height) {
+            BH_DespawnEntity(entities, BH_EntityHandleAt(entities, i));
+        }
     }
 }
 
-static struct BH_BB expand_bb(struct BH_BB bb, float by) {
-    return (struct BH_BB){
-        .top_left = {     bb.top_left.x - by,     bb.top_left.y + by },
-        .bottom_right = { bb.bottom_right.x + by, bb.bottom_right.y - by }
+static void spawn_test_emitter(struct BH_Context* ctx) {
+    struct game_state* game = ctx->user_state;
+
+    // clang-format off
+    struct BH_Emitter emitter = {
+        .bullet = {
+            .sprite = { .texture = game->star_texture },
+            .scale = { 8.0f, 8.0f },
+            .depth = 3.0f,
+            .bb = {
+                { -4.0f, -4.0f },
+                { 4.0f, 4.0f },
+            },
+            .shape = { .type = BH_SHAPE_CIRCLE, .radius = 4.0f },
+            .layer = ENEMY_BULLET_LAYER,
+        },
+        .position = { ctx->renderer.width / 2.0f, ctx->renderer.height / 4.0f },
+        .count = 64,
+        .arc = BH_TAU,
+        .spin = 0.1f,
+        .speed = 96.0f,
+        .speed_end = 96.0f,
+        .rate = 2.0f,
     };
+    // clang-format on
+
+    BH_AddEmitter(&ctx->emitters, emitter);
+
+    BH_RegisterSystem(
+        &ctx->systems,
+        (struct BH_System){
+            .callback = offscreen_bullet_system,
+            .components = BH_COMPONENT_MOTION,
+            .match_type = true,
+            .type = BH_BULLET,
+        }
+    );
 }
 
 struct player_state {
     float immunity;
 };
 
-static void update_player_system(struct BH_Context* ctx, struct BH_SpriteEntity* player) {
-    struct BH_BB bb = BH_BoxToWorld(player->position, expand_bb(player->bb, 0.15f));
-    struct BH_QTreeQuery collision_query = BH_QueryQTree(&ctx->entity_qtree, bb);
-
-    struct player_state* state = player->state;
-    for (size_t i = 0; i < collision_query.count; i++) {
-        struct BH_SpriteEntity* entity = collision_query.entities[i]->entity;
-
-        if (entity->type == BH_PLAYER) {
-            continue;
-        }
-
-        if (BH_DoEntitiesCollide(player, entity) && state->immunity <= 0.01f) {
+static void player_hit_handler(
+    struct BH_Context* ctx, const struct BH_CollisionPair* pairs, size_t count
+) {
+    for (size_t i = 0; i < count; i++) {
+        struct player_state* state = ctx->entities.states[pairs[i].entity];
+        if (state->immunity <= 0.01f) {
             state->immunity = 0.33f;
-            break;
         }
     }
+}
 
-    BH_DeinitQuery(collision_query);
+static void update_player_system(struct BH_Context* ctx, size_t player) {
+    struct BH_EntityPool* entities = &ctx->entities;
+    struct player_state* state = entities->states[player];
 
     /* Update immunity timer */
     state->immunity -= ctx->dt;
@@ -85,24 +160,24 @@ static void update_player_system(struct BH_Context* ctx, struct BH_SpriteEntity*
         state->immunity = 0.0f;
     }
 
+    struct vec2* position = &entities->positions[player];
     if (BH_GetKey(GLFW_KEY_W)) {
-        player->position.y -= 128.0f * ctx->dt;
+        position->y -= 128.0f * ctx->dt;
     }
     if (BH_GetKey(GLFW_KEY_S)) {
-        player->position.y += 128.0f * ctx->dt;
+        position->y += 128.0f * ctx->dt;
     }
     if (BH_GetKey(GLFW_KEY_A)) {
-        player->position.x -= 128.0f * ctx->dt;
+        position->x -= 128.0f * ctx->dt;
     }
     if (BH_GetKey(GLFW_KEY_D)) {
-        player->position.x += 128.0f * ctx->dt;
+        position->x += 128.0f * ctx->dt;
     }
 }
 
 static void spawn_player_entity(struct BH_Context* ctx) {
     struct BH_Sprite sprite = { 0 };
-    sprite.texture_handle =
-        BH_LoadTexture(&ctx->renderer.textures, (void*)ASSET_player, sizeof(ASSET_player) - 1);
+    sprite.texture = BH_GetAtlasRegion(&ctx->renderer.textures, "player");
 
     // clang-format off
     struct BH_SpriteEntity entity = {
@@ -116,30 +191,52 @@ static void spawn_player_entity(struct BH_Context* ctx) {
         },
         .type = BH_PLAYER,
         .callback = update_player_system,
+        .layer = PLAYER_LAYER,
+        .mask = ENEMY_BULLET_LAYER,
     };
     // clang-format on
 
     struct player_state state = { .immunity = 0.0f };
 
-    entity.state = calloc(1, sizeof(struct player_state));
-    memcpy(entity.state, &state, sizeof(struct player_state));
+    entity.state = &state;
+    entity.state_size = sizeof(state);
 
     BH_SpawnEntity(&ctx->entities, entity);
+
+    BH_RegisterCollisionHandler(
+        &ctx->collisions,
+        (struct BH_CollisionHandler){
+            .callback = player_hit_handler,
+            .layer = PLAYER_LAYER,
+            .mask = ENEMY_BULLET_LAYER,
+        }
+    );
 }
 
 bool user_init(struct BH_Context* ctx, void* state) {
     (void)state;
 
     spawn_test_entities(ctx);
+    spawn_test_emitter(ctx);
     spawn_player_entity(ctx);
 
     return true;
 }
 
-int main(void) {
-    struct BH_Context ctx = { 0 };
+int main(int argc, char** argv) {
+    struct BH_Context ctx = { .broadphase_type = BH_BROADPHASE_QTREE };
+    struct game_state game = { 0 };
+
+    /* --headless N runs N ticks without a window, for profiling */
+    if (argc == 3 && strcmp(argv[1], "--headless") == 0) {
+        ctx.headless_ticks = strtoul(argv[2], NULL, 10);
+    }
+    if (argc != 1 && ctx.headless_ticks == 0) {
+        error("Usage: %s [--headless TICKS]", argv[0]);
+        exit(1);
+    }
 
-    if (!BH_InitContext(&ctx, NULL, user_init)) {
+    if (!BH_InitContext(&ctx, &game, user_init)) {
         error("Context initialisation failed");
         exit(1);
     }
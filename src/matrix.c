@@ -61,6 +61,22 @@ void m4_multiply(m4 dest, m4 mat) {
     memcpy(dest, res, sizeof(res));
 }
 
+static float clampf(float x, float min, float max) { return x < min ? min : x > max ? max : x; }
+
+uint32_t pack_snorm2x16(float x, float y) {
+    uint16_t packed_x = (uint16_t)(int16_t)roundf(clampf(x, -1.0f, 1.0f) * 32767.0f);
+    uint16_t packed_y = (uint16_t)(int16_t)roundf(clampf(y, -1.0f, 1.0f) * 32767.0f);
+    return (uint32_t)packed_x | (uint32_t)packed_y << 16;
+}
+
+uint32_t pack_unorm4x8(float x, float y, float z, float w) {
+    uint32_t packed_x = (uint32_t)roundf(clampf(x, 0.0f, 1.0f) * 255.0f);
+    uint32_t packed_y = (uint32_t)roundf(clampf(y, 0.0f, 1.0f) * 255.0f);
+    uint32_t packed_z = (uint32_t)roundf(clampf(z, 0.0f, 1.0f) * 255.0f);
+    uint32_t packed_w = (uint32_t)roundf(clampf(w, 0.0f, 1.0f) * 255.0f);
+    return packed_x | packed_y << 8 | packed_z << 16 | packed_w << 24;
+}
+
 struct vec2 vec2_add(struct vec2 a, struct vec2 b) { return (struct vec2){ a.x + b.x, a.y + b.y }; }
 
 struct vec2 vec2_addf(struct vec2 v, float x) { return (struct vec2){ v.x + x, v.y + x }; }
@@ -2,6 +2,7 @@
 #define BH_MATRIX_H
 
 #include <glad/gl.h>
+#include <stdint.h>
 
 typedef GLfloat m4[4][4];
 
@@ -17,6 +18,10 @@ struct vec2 {
     float x, y;
 };
 
+/* Same bit layout as GLSL's packSnorm2x16 and packUnorm4x8 */
+uint32_t pack_snorm2x16(float x, float y);
+uint32_t pack_unorm4x8(float x, float y, float z, float w);
+
 struct vec2 vec2_add(struct vec2 a, struct vec2 b);
 struct vec2 vec2_addf(struct vec2 v, float x);
 struct vec2 vec2_subf(struct vec2 v, float x);
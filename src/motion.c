@@ -0,0 +1,152 @@
+#include "motion.h"
+
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Largest per-tick turn for which the polynomial sin/cos in the SSE path
+ * stay accurate to float precision. Faster turns take the scalar path. */
+#define MAX_POLY_ANGLE 0.25f
+
+static void IntegrateLinear(struct BH_EntityPool* pool, size_t i, float dt) {
+    struct vec2 v = pool->velocities[i];
+    struct vec2 a = pool->accelerations[i];
+    float angle = pool->angular_velocities[i] * dt;
+
+    v.x += a.x * dt;
+    v.y += a.y * dt;
+
+    if (angle != 0.0f) {
+        float c = cosf(angle);
+        float s = sinf(angle);
+        v = (struct vec2){ v.x * c - v.y * s, v.x * s + v.y * c };
+    }
+
+    /* An uncapped entity has FLT_MAX here, which squares to infinity */
+    float max_speed = pool->max_speeds[i];
+    float speed_sq = v.x * v.x + v.y * v.y;
+    if (speed_sq > max_speed * max_speed) {
+        float scale = max_speed / sqrtf(speed_sq);
+        v.x *= scale;
+        v.y *= scale;
+    }
+
+    pool->velocities[i] = v;
+    pool->positions[i].x += v.x * dt;
+    pool->positions[i].y += v.y * dt;
+}
+
+#ifdef __SSE2__
+/* Loads two consecutive floats as [a, a, b, b], to line up with two
+ * interleaved vec2s */
+static __m128 LoadPair(const float* p) {
+    __m128 pair = _mm_castpd_ps(_mm_load_sd((const double*)p));
+    return _mm_unpacklo_ps(pair, pair);
+}
+
+/* Taylor series, exact for the common angle == 0 */
+static __m128 PolyCos(__m128 x_sq) {
+    /* 1 - x^2 (1/2 - x^2/24) */
+    __m128 r = _mm_mul_ps(x_sq, _mm_set1_ps(1.0f / 24.0f));
+    r = _mm_mul_ps(x_sq, _mm_sub_ps(_mm_set1_ps(0.5f), r));
+    return _mm_sub_ps(_mm_set1_ps(1.0f), r);
+}
+
+static __m128 PolySin(__m128 x, __m128 x_sq) {
+    /* x (1 - x^2 (1/6 - x^2/120)) */
+    __m128 r = _mm_mul_ps(x_sq, _mm_set1_ps(1.0f / 120.0f));
+    r = _mm_mul_ps(x_sq, _mm_sub_ps(_mm_set1_ps(1.0f / 6.0f), r));
+    return _mm_mul_ps(x, _mm_sub_ps(_mm_set1_ps(1.0f), r));
+}
+
+/* Two entities per register, as positions etc. are interleaved x/y */
+static size_t IntegrateLinearSSE(struct BH_EntityPool* pool, float dt) {
+    float* positions = (float*)pool->positions;
+    float* velocities = (float*)pool->velocities;
+    const float* accelerations = (const float*)pool->accelerations;
+
+    const __m128 dt4 = _mm_set1_ps(dt);
+    const __m128 max_angle = _mm_set1_ps(MAX_POLY_ANGLE);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    /* x' = x * c - y * s, y' = y * c + x * s */
+    const __m128 rotation_sign = _mm_set_ps(1.0f, -1.0f, 1.0f, -1.0f);
+
+    size_t i = 0;
+    for (; i + 2 <= pool->count; i += 2) {
+        __m128 angle = _mm_mul_ps(LoadPair(&pool->angular_velocities[i]), dt4);
+
+        if (_mm_movemask_ps(_mm_cmpgt_ps(_mm_and_ps(angle, abs_mask), max_angle))) {
+            IntegrateLinear(pool, i, dt);
+            IntegrateLinear(pool, i + 1, dt);
+            continue;
+        }
+
+        __m128 v = _mm_loadu_ps(&velocities[2 * i]);
+        __m128 a = _mm_loadu_ps(&accelerations[2 * i]);
+        v = _mm_add_ps(v, _mm_mul_ps(a, dt4));
+
+        __m128 angle_sq = _mm_mul_ps(angle, angle);
+        __m128 c = PolyCos(angle_sq);
+        __m128 s = PolySin(angle, angle_sq);
+
+        __m128 swapped = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_add_ps(_mm_mul_ps(v, c), _mm_mul_ps(_mm_mul_ps(swapped, s), rotation_sign));
+
+        /* Speed cap */
+        __m128 sq = _mm_mul_ps(v, v);
+        __m128 speed_sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+        __m128 max_speed = LoadPair(&pool->max_speeds[i]);
+        __m128 over = _mm_cmpgt_ps(speed_sq, _mm_mul_ps(max_speed, max_speed));
+
+        if (_mm_movemask_ps(over)) {
+            __m128 scaled = _mm_mul_ps(v, _mm_div_ps(max_speed, _mm_sqrt_ps(speed_sq)));
+            v = _mm_or_ps(_mm_and_ps(over, scaled), _mm_andnot_ps(over, v));
+        }
+
+        _mm_storeu_ps(&velocities[2 * i], v);
+
+        __m128 p = _mm_loadu_ps(&positions[2 * i]);
+        _mm_storeu_ps(&positions[2 * i], _mm_add_ps(p, _mm_mul_ps(v, dt4)));
+    }
+
+    return i;
+}
+
+static size_t IntegrateRotationsSSE(struct BH_EntityPool* pool, float dt) {
+    const __m128 dt4 = _mm_set1_ps(dt);
+
+    size_t i = 0;
+    for (; i + 4 <= pool->count; i += 4) {
+        __m128 rotation = _mm_loadu_ps(&pool->rotations[i]);
+        __m128 angular_velocity = _mm_loadu_ps(&pool->angular_velocities[i]);
+        rotation = _mm_add_ps(rotation, _mm_mul_ps(angular_velocity, dt4));
+        _mm_storeu_ps(&pool->rotations[i], rotation);
+    }
+
+    return i;
+}
+#endif
+
+void BH_IntegrateMotion(struct BH_EntityPool* pool, float dt) {
+    size_t linear_done = 0;
+    size_t rotations_done = 0;
+
+#ifdef __SSE2__
+    linear_done = IntegrateLinearSSE(pool, dt);
+    rotations_done = IntegrateRotationsSSE(pool, dt);
+#endif
+
+    for (size_t i = linear_done; i < pool->count; i++) {
+        IntegrateLinear(pool, i, dt);
+    }
+
+    for (size_t i = rotations_done; i < pool->count; i++) {
+        pool->rotations[i] += pool->angular_velocities[i] * dt;
+    }
+
+    for (size_t i = 0; i < pool->count; i++) {
+        pool->dirty[i] |= (pool->components[i] & BH_COMPONENT_MOTION) != 0;
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "entities.h"
+
+/* Integrates every entity with BH_COMPONENT_MOTION in one pass:
+ *
+ *   velocity = cap(rotate(velocity + acceleration * dt, angular_velocity * dt))
+ *   position += velocity * dt
+ *   rotation += angular_velocity * dt
+ *
+ * Uses SSE when available. */
+void BH_IntegrateMotion(struct BH_EntityPool* pool, float dt);
@@ -1,166 +1,589 @@
 #include "qtree.h"
 #include "error_macro.h"
-#include "matrix.h"
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-bool BH_IsPointInBox(struct BH_BB box, struct vec2 point) {
-    return point.x >= box.top_left.x && point.x <= box.bottom_right.x &&
-           point.y >= box.top_left.y && point.y <= box.bottom_right.y;
+#define QTREE_START_CAPACITY 256
+#define QTREE_GROW_FACTOR 2
+
+bool BH_InitQTree(struct BH_QTree* qtree, size_t leaf_capacity, size_t max_depth) {
+    if (leaf_capacity == 0 || max_depth == 0 || max_depth > BH_QTREE_DEPTH_LIMIT) {
+        error("Invalid qtree leaf capacity %zu or max depth %zu", leaf_capacity, max_depth);
+        return false;
+    }
+
+    *qtree = (struct BH_QTree){
+        .leaf_capacity = leaf_capacity,
+        .max_depth = max_depth,
+    };
+
+    return true;
 }
 
-bool BH_DoBoxesIntersect(struct BH_BB box, struct BH_BB other) {
-    return box.top_left.x <= other.bottom_right.x && box.bottom_right.x >= other.top_left.x &&
-           box.top_left.y <= other.bottom_right.y && box.bottom_right.y >= other.top_left.y;
+void BH_ClearQTree(struct BH_QTree* qtree) {
+    qtree->pass++;
+    if (qtree->pass == 0) {
+        memset(qtree->passes, 0, qtree->count * sizeof(uint32_t));
+        qtree->pass = 1;
+    }
+
+    /* Without nodes to refit, there is nothing worth keeping */
+    if (!qtree->refitting || qtree->node_count == 0) {
+        qtree->count = 0;
+        qtree->sorted_count = 0;
+        qtree->node_count = 0;
+    }
 }
 
-struct vec2 BH_BoxCentre(struct BH_BB bb) {
-    return (struct vec2){ (bb.top_left.x + bb.bottom_right.x) / 2.0f,
-                          (bb.top_left.y + bb.bottom_right.y) / 2.0f };
+static bool GrowEntities(struct BH_QTree* qtree) {
+    size_t capacity = qtree->capacity ? qtree->capacity * QTREE_GROW_FACTOR : QTREE_START_CAPACITY;
+
+    struct BH_SpatialEntity* entities =
+        realloc(qtree->entities, capacity * sizeof(struct BH_SpatialEntity));
+    if (entities != NULL) {
+        qtree->entities = entities;
+    }
+    struct BH_SpatialEntity* sort_entities =
+        realloc(qtree->sort_entities, capacity * sizeof(struct BH_SpatialEntity));
+    if (sort_entities != NULL) {
+        qtree->sort_entities = sort_entities;
+    }
+    uint32_t* codes = realloc(qtree->codes, capacity * sizeof(uint32_t));
+    if (codes != NULL) {
+        qtree->codes = codes;
+    }
+    uint32_t* sort_codes = realloc(qtree->sort_codes, capacity * sizeof(uint32_t));
+    if (sort_codes != NULL) {
+        qtree->sort_codes = sort_codes;
+    }
+    uint32_t* passes = realloc(qtree->passes, capacity * sizeof(uint32_t));
+    if (passes != NULL) {
+        qtree->passes = passes;
+    }
+
+    if (entities == NULL || sort_entities == NULL || codes == NULL || sort_codes == NULL ||
+        passes == NULL) {
+        error("Failed to allocate memory");
+        return false;
+    }
+
+    qtree->capacity = capacity;
+    return true;
 }
 
-struct vec2 BH_BoxDimensions(struct BH_BB bb) {
-    return (struct vec2){ bb.bottom_right.x - bb.top_left.x, bb.bottom_right.y - bb.top_left.y };
+/* Spreads the low 16 bits of `v` out over the even bits */
+static uint32_t SpreadBits(uint32_t v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
 }
 
-struct BH_BB BH_BoxToWorld(struct vec2 centre, struct BH_BB dimensions) {
+static uint32_t Quantise(float value, float min, float size, uint32_t cells) {
+    float cell = (value - min) / size * cells;
+    /* Also catches NaN */
+    if (!(cell >= 0.0f)) {
+        return 0;
+    }
+    if (cell >= cells) {
+        return cells - 1;
+    }
+    return (uint32_t)cell;
+}
+
+/* x in the even bits and y in the odd ones, so that the top two bits give
+ * the quadrant of the root, the next two that within the quadrant, etc. */
+static uint32_t MortonCode(const struct BH_QTree* qtree, struct vec2 point) {
+    uint32_t cells = 1u << qtree->max_depth;
+    struct vec2 size = BH_BoxDimensions(qtree->bb);
+
+    uint32_t x = Quantise(point.x, qtree->bb.top_left.x, size.x, cells);
+    uint32_t y = Quantise(point.y, qtree->bb.top_left.y, size.y, cells);
+
+    return SpreadBits(x) | (SpreadBits(y) << 1);
+}
+
+/* Returns the index of the entity in `entities`, or SIZE_MAX */
+static size_t FindEntity(const struct BH_QTree* qtree, struct BH_EntityHandle handle) {
+    if (handle.index >= qtree->position_capacity) {
+        return SIZE_MAX;
+    }
+
+    /* Positions are never cleared, so they may be stale */
+    size_t i = qtree->positions[handle.index];
+    if (i >= qtree->count || qtree->entities[i].handle.index != handle.index ||
+        qtree->entities[i].handle.generation != handle.generation) {
+        return SIZE_MAX;
+    }
+
+    return i;
+}
+
+static bool SetPosition(struct BH_QTree* qtree, struct BH_EntityHandle handle, size_t i) {
+    if (handle.index >= qtree->position_capacity) {
+        size_t capacity = qtree->position_capacity ? qtree->position_capacity : QTREE_START_CAPACITY;
+        while (capacity <= handle.index) {
+            capacity *= QTREE_GROW_FACTOR;
+        }
+
+        uint32_t* positions = realloc(qtree->positions, capacity * sizeof(uint32_t));
+        if (positions == NULL) {
+            error("Failed to allocate memory");
+            return false;
+        }
+        qtree->positions = positions;
+        qtree->position_capacity = capacity;
+    }
+
+    qtree->positions[handle.index] = i;
+    return true;
+}
+
+bool BH_InsertQTree(struct BH_QTree* qtree, struct BH_SpatialEntity entity) {
+    if (qtree->refitting) {
+        size_t i = FindEntity(qtree, entity.handle);
+        if (i != SIZE_MAX) {
+            qtree->entities[i] = entity;
+            qtree->passes[i] = qtree->pass;
+            return true;
+        }
+    }
+
+    if (qtree->count >= qtree->capacity && !GrowEntities(qtree)) {
+        return false;
+    }
+
+    if (qtree->refitting && !SetPosition(qtree, entity.handle, qtree->count)) {
+        return false;
+    }
+
+    qtree->entities[qtree->count] = entity;
+    qtree->passes[qtree->count] = qtree->pass;
+    qtree->count++;
+
+    return true;
+}
+
+/* Fits the tree to wherever the entities are this time round, so nothing
+ * is ever out of bounds. NaN points are left out and end up in cell 0. */
+static void FitBounds(struct BH_QTree* qtree) {
+    qtree->bb = (struct BH_BB){ { 0.0f, 0.0f }, { 0.0f, 0.0f } };
+    bool first = true;
+
+    for (size_t i = 0; i < qtree->count; i++) {
+        struct vec2 point = qtree->entities[i].point;
+        if (isnan(point.x) || isnan(point.y)) {
+            continue;
+        }
+
+        if (first) {
+            qtree->bb = (struct BH_BB){ point, point };
+            first = false;
+            continue;
+        }
+
+        qtree->bb.top_left.x = fminf(qtree->bb.top_left.x, point.x);
+        qtree->bb.top_left.y = fminf(qtree->bb.top_left.y, point.y);
+        qtree->bb.bottom_right.x = fmaxf(qtree->bb.bottom_right.x, point.x);
+        qtree->bb.bottom_right.y = fmaxf(qtree->bb.bottom_right.y, point.y);
+    }
+}
+
+/* LSD radix sort, a byte at a time, of only as many bytes as codes have.
+ * `passes` is left alone: after DropDespawned every entity has the same. */
+static void SortByCode(struct BH_QTree* qtree) {
+    if (qtree->count == 0) {
+        return;
+    }
+
+    for (size_t shift = 0; shift < 2 * qtree->max_depth; shift += 8) {
+        size_t offsets[256] = { 0 };
+        for (size_t i = 0; i < qtree->count; i++) {
+            offsets[(qtree->codes[i] >> shift) & 0xff]++;
+        }
+
+        /* All codes share this byte */
+        if (offsets[(qtree->codes[0] >> shift) & 0xff] == qtree->count) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t byte = 0; byte < 256; byte++) {
+            size_t count = offsets[byte];
+            offsets[byte] = offset;
+            offset += count;
+        }
+
+        for (size_t i = 0; i < qtree->count; i++) {
+            size_t to = offsets[(qtree->codes[i] >> shift) & 0xff]++;
+            qtree->sort_codes[to] = qtree->codes[i];
+            qtree->sort_entities[to] = qtree->entities[i];
+        }
+
+        uint32_t* codes = qtree->codes;
+        qtree->codes = qtree->sort_codes;
+        qtree->sort_codes = codes;
+
+        struct BH_SpatialEntity* entities = qtree->entities;
+        qtree->entities = qtree->sort_entities;
+        qtree->sort_entities = entities;
+    }
+}
+
+/* Returns the index of the first of `count` new nodes, or 0 on failure */
+static uint32_t AddNodes(struct BH_QTree* qtree, size_t count) {
+    if (qtree->node_count + count > qtree->node_capacity) {
+        size_t capacity =
+            qtree->node_capacity ? qtree->node_capacity * QTREE_GROW_FACTOR : QTREE_START_CAPACITY;
+        struct BH_QTreeNode* nodes = realloc(qtree->nodes, capacity * sizeof(struct BH_QTreeNode));
+        if (nodes == NULL) {
+            error("Failed to allocate memory");
+            return 0;
+        }
+        qtree->nodes = nodes;
+        qtree->node_capacity = capacity;
+    }
+
+    uint32_t first = qtree->node_count;
+    qtree->node_count += count;
+    return first;
+}
+
+/* Never found by queries, and infinitely far away */
+static const struct BH_BB EMPTY_BOX = {
+    .top_left = { INFINITY, INFINITY },
+    .bottom_right = { -INFINITY, -INFINITY },
+};
+
+static struct BH_BB BoxUnion(struct BH_BB box, struct BH_BB other) {
     return (struct BH_BB){
-        .top_left = vec2_add(dimensions.top_left, centre),
-        .bottom_right = vec2_add(dimensions.bottom_right, centre),
+        .top_left = { fminf(box.top_left.x, other.top_left.x),
+                      fminf(box.top_left.y, other.top_left.y) },
+        .bottom_right = { fmaxf(box.bottom_right.x, other.bottom_right.x),
+                          fmaxf(box.bottom_right.y, other.bottom_right.y) },
     };
 }
 
-static struct BH_QTree* Subdivide(struct vec2 top_left, struct vec2 bottom_right) {
-    struct BH_QTree* qtree = calloc(1, sizeof(struct BH_QTree));
+/* Children always come after their parent, so going backwards every node
+ * is fitted after its children are. Returns the total area of the leaves,
+ * which grows as entities wander off from where they were sorted to. */
+static float FitNodes(struct BH_QTree* qtree) {
+    float leaf_area = 0.0f;
 
-    qtree->bb = (struct BH_BB){
-        .top_left = top_left,
-        .bottom_right = bottom_right,
-    };
+    for (size_t i = qtree->node_count; i-- > 0;) {
+        struct BH_QTreeNode* node = &qtree->nodes[i];
+        struct BH_BB bb = EMPTY_BOX;
+
+        if (BH_IsQTreeLeaf(node)) {
+            for (uint32_t e = node->first; e < node->first + node->count; e++) {
+                bb = BoxUnion(bb, qtree->entities[e].bb);
+            }
+
+            struct vec2 size = BH_BoxDimensions(bb);
+            if (size.x > 0.0f && size.y > 0.0f) {
+                leaf_area += size.x * size.y;
+            }
+        } else {
+            for (uint32_t child = 0; child < 4; child++) {
+                bb = BoxUnion(bb, qtree->nodes[node->children + child].bb);
+            }
+        }
+
+        node->bb = bb;
+    }
 
-    return qtree;
+    return leaf_area;
 }
 
-static void qtree_subdivide(struct BH_QTree* qtree) {
-    const struct vec2 centre = BH_BoxCentre(qtree->bb);
+/* Recurses at most max_depth levels deep */
+static bool SplitNode(struct BH_QTree* qtree, uint32_t node, size_t depth) {
+    /* Adding nodes may move the array */
+    struct BH_QTreeNode parent = qtree->nodes[node];
+    if (parent.count <= qtree->leaf_capacity || depth == qtree->max_depth) {
+        return true;
+    }
+
+    uint32_t children = AddNodes(qtree, 4);
+    if (children == 0) {
+        return false;
+    }
+    qtree->nodes[node].children = children;
+
+    /* The entities are sorted, so each quadrant is a run of them */
+    size_t shift = 2 * (qtree->max_depth - 1 - depth);
+    uint32_t first = parent.first;
+    uint32_t end = parent.first + parent.count;
+
+    for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+        uint32_t last = first;
+        while (last < end && ((qtree->codes[last] >> shift) & 3) == quadrant) {
+            last++;
+        }
+
+        qtree->nodes[children + quadrant] = (struct BH_QTreeNode){
+            .first = first,
+            .count = last - first,
+        };
+        first = last;
+    }
 
-    qtree->top_left = Subdivide(qtree->bb.top_left, centre);
-    qtree->top_right = Subdivide(
-        (struct vec2){ centre.x, qtree->bb.top_left.y },
-        (struct vec2){ qtree->bb.bottom_right.x, centre.y }
-    );
-    qtree->bottom_left = Subdivide(
-        (struct vec2){ qtree->bb.top_left.x, centre.y },
-        (struct vec2){ centre.x, qtree->bb.bottom_right.y }
-    );
-    qtree->bottom_right = Subdivide(centre, qtree->bb.bottom_right);
+    for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+        if (!SplitNode(qtree, children + quadrant, depth + 1)) {
+            return false;
+        }
+    }
+
+    return true;
+}
 
-    for (size_t i = 0; i < qtree->element_count; i++) {
-        BH_InsertQTree(qtree, qtree->elements[i]);
+/* Returns how many entities were not inserted since the last clear, after
+ * giving them empty boxes. `passes[i]` stays with `entities[i]` through
+ * rebuilds, see DropDespawned. */
+static size_t MarkDespawned(struct BH_QTree* qtree) {
+    size_t despawned = 0;
+    for (size_t i = 0; i < qtree->count; i++) {
+        if (qtree->passes[i] != qtree->pass) {
+            qtree->entities[i].bb = EMPTY_BOX;
+            despawned++;
+        }
     }
+    return despawned;
 }
 
-bool BH_IsQTreeLeaf(struct BH_QTree* qtree) {
-    /* TODO: assert here */
-    if (qtree == NULL) {
-        error("qtree == NULL");
+static void DropDespawned(struct BH_QTree* qtree) {
+    size_t count = 0;
+    for (size_t i = 0; i < qtree->count; i++) {
+        if (qtree->passes[i] == qtree->pass) {
+            qtree->entities[count] = qtree->entities[i];
+            qtree->passes[count] = qtree->passes[i];
+            count++;
+        }
     }
-    return qtree->top_left == NULL;
+    qtree->count = count;
 }
 
-// See: https://en.wikipedia.org/wiki/Quadtree
-bool BH_InsertQTree(struct BH_QTree* qtree, struct BH_QTreeEntity entity) {
-    if (!BH_IsPointInBox(qtree->bb, entity.point)) {
+static bool RebuildQTree(struct BH_QTree* qtree) {
+    DropDespawned(qtree);
+    FitBounds(qtree);
+    for (size_t i = 0; i < qtree->count; i++) {
+        qtree->codes[i] = MortonCode(qtree, qtree->entities[i].point);
+    }
+    SortByCode(qtree);
+
+    /* The root is the one node that can be at index 0 */
+    qtree->node_count = 0;
+    AddNodes(qtree, 1);
+    if (qtree->node_count == 0) {
         return false;
     }
+    qtree->nodes[0] = (struct BH_QTreeNode){ .count = qtree->count };
 
-    if (qtree->element_count < QT_MAX_ELEMENTS && BH_IsQTreeLeaf(qtree)) {
-        qtree->elements[qtree->element_count++] = entity;
-        return true;
+    if (!SplitNode(qtree, 0, 0)) {
+        qtree->node_count = 0;
+        return false;
     }
 
-    if (BH_IsQTreeLeaf(qtree)) {
-        qtree_subdivide(qtree);
+    /* Past the limit, refitting saves too little over sorting to pay for
+     * looking every entity up */
+    qtree->sorted_count = qtree->count;
+    qtree->refitting = qtree->incremental && qtree->count <= BH_QTREE_REFIT_LIMIT;
+    if (qtree->refitting) {
+        for (size_t i = 0; i < qtree->count; i++) {
+            if (!SetPosition(qtree, qtree->entities[i].handle, i)) {
+                qtree->node_count = 0;
+                qtree->refitting = false;
+                return false;
+            }
+        }
     }
 
-    if (BH_InsertQTree(qtree->top_left, entity))
-        return true;
-    if (BH_InsertQTree(qtree->top_right, entity))
-        return true;
-    if (BH_InsertQTree(qtree->bottom_left, entity))
-        return true;
-    if (BH_InsertQTree(qtree->bottom_right, entity))
-        return true;
+    qtree->leaf_area = FitNodes(qtree);
+    return true;
+}
+
+bool BH_BuildQTree(struct BH_QTree* qtree) {
+    if (!qtree->refitting || qtree->node_count == 0) {
+        return RebuildQTree(qtree);
+    }
+
+    /* Spawned and despawned entities are gone through one by one */
+    size_t changed = MarkDespawned(qtree) + (qtree->count - qtree->sorted_count);
+    if (changed > qtree->count * BH_QTREE_REBUILD_FRACTION) {
+        return RebuildQTree(qtree);
+    }
+
+    /* Looser leaves make every query visit more of them */
+    if (FitNodes(qtree) > qtree->leaf_area * BH_QTREE_REFIT_SLACK) {
+        return RebuildQTree(qtree);
+    }
 
-    // Should be unreachable
-    return false;
+    return true;
 }
 
-#define QUERY_START_CAPACITY 32
-static struct BH_QTreeQuery InitQuery(void) {
-    return (struct BH_QTreeQuery){
-        .entities = calloc(QUERY_START_CAPACITY, sizeof(struct BH_QTreeEntity*)),
-        .count = 0,
-        .capacity = QUERY_START_CAPACITY,
-    };
+bool BH_IsQTreeLeaf(const struct BH_QTreeNode* node) {
+    return node->children == 0;
 }
 
-#define QUERY_GROW_FACTOR 2
-static void QueryAppend(struct BH_QTreeQuery* query, struct BH_QTreeEntity* entity) {
-    if (query->count >= query->capacity) {
-        query->capacity *= QUERY_GROW_FACTOR;
-        query->entities =
-            realloc(query->entities, query->capacity * sizeof(struct BH_QTreeEntity*));
+bool BH_VisitQTree(struct BH_QTree* qtree, struct BH_BB box, BH_SpatialVisitCB visit, void* data) {
+    if (qtree->node_count == 0) {
+        return true;
+    }
+
+    for (size_t i = qtree->sorted_count; i < qtree->count; i++) {
+        if (BH_DoBoxesIntersect(box, qtree->entities[i].bb) && !visit(&qtree->entities[i], data)) {
+            return false;
+        }
+    }
+
+    /* Every level visited pops one node and pushes four */
+    uint32_t stack[3 * BH_QTREE_DEPTH_LIMIT + 1];
+    size_t top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const struct BH_QTreeNode* node = &qtree->nodes[stack[--top]];
+        if (!BH_DoBoxesIntersect(box, node->bb)) {
+            continue;
+        }
+
+        if (BH_IsQTreeLeaf(node)) {
+            for (uint32_t i = node->first; i < node->first + node->count; i++) {
+                if (BH_DoBoxesIntersect(box, qtree->entities[i].bb) &&
+                    !visit(&qtree->entities[i], data)) {
+                    return false;
+                }
+            }
+        } else {
+            for (uint32_t child = 0; child < 4; child++) {
+                stack[top++] = node->children + child;
+            }
+        }
     }
-    query->entities[query->count++] = entity;
+
+    return true;
 }
 
+/* Pushes the `count` children in `children` farthest first, so that the
+ * nearest is popped next */
 static void
-QueryRecursively(struct BH_QTree* qtree, struct BH_BB box, struct BH_QTreeQuery* query) {
-    if (qtree == NULL || query == NULL) {
-        return;
+PushNearestFirst(uint32_t* stack, size_t* top, uint32_t* children, float* distances, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        for (size_t j = i; j > 0 && distances[j - 1] < distances[j]; j--) {
+            float distance = distances[j];
+            distances[j] = distances[j - 1];
+            distances[j - 1] = distance;
+
+            uint32_t child = children[j];
+            children[j] = children[j - 1];
+            children[j - 1] = child;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        stack[(*top)++] = children[i];
     }
+}
 
-    if (!BH_DoBoxesIntersect(box, qtree->bb)) {
+void BH_KNearestQTree(struct BH_QTree* qtree, struct BH_NearestSearch* search) {
+    if (qtree->node_count == 0 || search->k == 0) {
         return;
     }
 
-    if (BH_IsQTreeLeaf(qtree)) {
-        for (size_t i = 0; i < qtree->element_count; i++) {
-            QueryAppend(query, &qtree->elements[i]);
-        }
-    } else {
-        QueryRecursively(qtree->top_left, box, query);
-        QueryRecursively(qtree->top_right, box, query);
-        QueryRecursively(qtree->bottom_left, box, query);
-        QueryRecursively(qtree->bottom_right, box, query);
+    for (size_t i = qtree->sorted_count; i < qtree->count; i++) {
+        BH_OfferNearest(search, &qtree->entities[i]);
     }
-}
 
-struct BH_QTreeQuery BH_QueryQTree(struct BH_QTree* qtree, struct BH_BB box) {
-    struct BH_QTreeQuery query = InitQuery();
-    QueryRecursively(qtree, box, &query);
-    return query;
-}
+    uint32_t stack[3 * BH_QTREE_DEPTH_LIMIT + 1];
+    size_t top = 0;
+    stack[top++] = 0;
 
-void BH_DeinitQTree(struct BH_QTree* qtree) {
-    if (qtree->top_left) {
-        BH_DeinitQTree(qtree->top_left);
-        free(qtree->top_left);
+    while (top > 0) {
+        const struct BH_QTreeNode* node = &qtree->nodes[stack[--top]];
+        /* The bound may have shrunk since the node was pushed */
+        if (BH_BoxDistance(node->bb, search->point) > BH_NearestBound(search)) {
+            continue;
+        }
+
+        if (BH_IsQTreeLeaf(node)) {
+            for (uint32_t i = node->first; i < node->first + node->count; i++) {
+                BH_OfferNearest(search, &qtree->entities[i]);
+            }
+            continue;
+        }
+
+        uint32_t children[4];
+        float distances[4];
+        size_t count = 0;
+        for (uint32_t child = 0; child < 4; child++) {
+            float distance = BH_BoxDistance(qtree->nodes[node->children + child].bb, search->point);
+            if (distance <= BH_NearestBound(search)) {
+                children[count] = node->children + child;
+                distances[count] = distance;
+                count++;
+            }
+        }
+
+        PushNearestFirst(stack, &top, children, distances, count);
     }
-    if (qtree->top_right) {
-        BH_DeinitQTree(qtree->top_right);
-        free(qtree->top_right);
+}
+
+void BH_RaycastQTree(struct BH_QTree* qtree, struct BH_RaySearch* search) {
+    if (qtree->node_count == 0) {
+        return;
     }
-    if (qtree->bottom_left) {
-        BH_DeinitQTree(qtree->bottom_left);
-        free(qtree->bottom_left);
+
+    for (size_t i = qtree->sorted_count; i < qtree->count; i++) {
+        BH_OfferRay(search, &qtree->entities[i]);
     }
-    if (qtree->bottom_right) {
-        BH_DeinitQTree(qtree->bottom_right);
-        free(qtree->bottom_right);
+
+    uint32_t stack[3 * BH_QTREE_DEPTH_LIMIT + 1];
+    size_t top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const struct BH_QTreeNode* node = &qtree->nodes[stack[--top]];
+        float distance;
+        if (!BH_RayHitsBox(
+                search->origin, search->direction, node->bb, search->max_distance, &distance
+            )) {
+            continue;
+        }
+
+        if (BH_IsQTreeLeaf(node)) {
+            for (uint32_t i = node->first; i < node->first + node->count; i++) {
+                BH_OfferRay(search, &qtree->entities[i]);
+            }
+            continue;
+        }
+
+        uint32_t children[4];
+        float distances[4];
+        size_t count = 0;
+        for (uint32_t child = 0; child < 4; child++) {
+            const struct BH_QTreeNode* node_child = &qtree->nodes[node->children + child];
+            if (BH_RayHitsBox(
+                    search->origin, search->direction, node_child->bb, search->max_distance,
+                    &distances[count]
+                )) {
+                children[count++] = node->children + child;
+            }
+        }
+
+        PushNearestFirst(stack, &top, children, distances, count);
     }
 }
 
-void BH_DeinitQuery(struct BH_QTreeQuery query) { free(query.entities); }
+void BH_DeinitQTree(struct BH_QTree* qtree) {
+    free(qtree->passes);
+    free(qtree->positions);
+    free(qtree->entities);
+    free(qtree->codes);
+    free(qtree->sort_entities);
+    free(qtree->sort_codes);
+    free(qtree->nodes);
+    *qtree = (struct BH_QTree){ 0 };
+}
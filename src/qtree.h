@@ -1,44 +1,93 @@
 #pragma once
 
 #include "entitydef.h"
-#include "matrix.h"
+#include "spatial.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-#define QT_MAX_ELEMENTS 4
+/* Defaults for BH_InitQTree */
+#define BH_QTREE_LEAF_CAPACITY 8
+#define BH_QTREE_MAX_DEPTH 8
+/* Points are quantised to 2^max_depth cells per axis, in 32-bit codes */
+#define BH_QTREE_DEPTH_LIMIT 16
+/* An incremental build only refits the nodes while fewer than this share
+ * of the entities spawned or despawned since the last full one, and while
+ * the leaves have grown by less than the slack. Tuned with `make bench`. */
+#define BH_QTREE_REBUILD_FRACTION 0.05f
+#define BH_QTREE_REFIT_SLACK 1.5f
+/* Above this many entities, always rebuilding is about as quick */
+#define BH_QTREE_REFIT_LIMIT 8192
 
-bool BH_IsPointInBox(struct BH_BB box, struct vec2 point);
-bool BH_DoBoxesIntersect(struct BH_BB box, struct BH_BB other);
-
-struct BH_QTreeEntity {
-    struct vec2 point;
-    struct BH_SpriteEntity* entity;
+/* The entities of a node are `entities[first, first + count)`. A node
+ * either is a leaf or has four children, stored next to each other from
+ * `children` on, in Morton order: top left, top right, bottom left,
+ * bottom right.
+ *
+ * `bb` is fitted to the boxes of the node's entities rather than being
+ * its quadrant, so large entities are found from anywhere they overlap.
+ * Siblings may overlap, and an empty node's box is inverted. */
+struct BH_QTreeNode {
+    struct BH_BB bb;
+    uint32_t first;
+    uint32_t count;
+    uint32_t children; /* 0 for leaves, as the root is never a child */
 };
 
+/* A linear quadtree. Entities are inserted in any order, then
+ * BH_BuildQTree fits `bb` to their points and sorts them by Morton code
+ * within it, so every node covers a contiguous run of them, and lays the
+ * nodes out in `nodes`, root first. All arrays are kept between builds and
+ * only ever grow.
+ *
+ * If `incremental` is set, and the last full build had no more than
+ * BH_QTREE_REFIT_LIMIT entities, clearing keeps the entities and nodes, and
+ * inserting an entity again, by handle, updates it where it is. Building
+ * then just refits the node boxes while that keeps them tight enough:
+ * entities that left their leaf stay in it and stretch its box. New
+ * entities wait in `entities[sorted_count, count)`, which queries go
+ * through one by one, and ones not inserted again get an empty box until
+ * the next full build drops them. */
 struct BH_QTree {
-    struct BH_QTreeEntity elements[QT_MAX_ELEMENTS];
-    size_t element_count;
+    struct BH_BB bb; /* of the points, set by BH_BuildQTree */
+    size_t leaf_capacity;
+    size_t max_depth;
 
-    struct BH_BB bb;
+    struct BH_SpatialEntity* entities;
+    uint32_t* codes;
+    size_t count;
+    size_t capacity;
 
-    struct BH_QTree* top_left;
-    struct BH_QTree* top_right;
-    struct BH_QTree* bottom_left;
-    struct BH_QTree* bottom_right;
-};
+    /* Other half of the radix sort's ping-pong */
+    struct BH_SpatialEntity* sort_entities;
+    uint32_t* sort_codes;
 
-bool BH_InsertQTree(struct BH_QTree* qtree, struct BH_QTreeEntity point);
-struct BH_QTreeQuery BH_QueryQTree(struct BH_QTree* qtree, struct BH_BB box);
-void BH_DeinitQTree(struct BH_QTree* qtree);
-bool BH_IsQTreeLeaf(struct BH_QTree* qtree);
+    struct BH_QTreeNode* nodes;
+    size_t node_count;
+    size_t node_capacity;
 
-struct BH_QTreeQuery {
-    struct BH_QTreeEntity** entities;
-    size_t count;
-    size_t capacity;
+    bool incremental;
+    bool refitting; /* whether the last full build kept `positions` for refits */
+    size_t sorted_count;
+    uint32_t* passes; /* the clear each entity was last inserted after */
+    uint32_t pass;
+    float leaf_area;     /* total area of the leaves after the last full build */
+    uint32_t* positions; /* handle index -> index in `entities` */
+    size_t position_capacity;
 };
 
-void BH_DeinitQuery(struct BH_QTreeQuery query);
-
-struct vec2 BH_BoxCentre(struct BH_BB bb);
-struct vec2 BH_BoxDimensions(struct BH_BB bb);
-struct BH_BB BH_BoxToWorld(struct vec2 centre, struct BH_BB dimensions);
+/* Nodes with more than `leaf_capacity` entities are split, unless they are
+ * `max_depth` levels deep. Points on top of each other then share a leaf. */
+bool BH_InitQTree(struct BH_QTree* qtree, size_t leaf_capacity, size_t max_depth);
+void BH_ClearQTree(struct BH_QTree* qtree);
+bool BH_InsertQTree(struct BH_QTree* qtree, struct BH_SpatialEntity entity);
+bool BH_BuildQTree(struct BH_QTree* qtree);
+/* Visits the entities whose boxes overlap `box`, returns false if `visit`
+ * stopped early */
+bool BH_VisitQTree(struct BH_QTree* qtree, struct BH_BB box, BH_SpatialVisitCB visit, void* data);
+/* Descend into the nearest children first and skip nodes that cannot
+ * beat the hits so far */
+void BH_KNearestQTree(struct BH_QTree* qtree, struct BH_NearestSearch* search);
+void BH_RaycastQTree(struct BH_QTree* qtree, struct BH_RaySearch* search);
+void BH_DeinitQTree(struct BH_QTree* qtree);
+bool BH_IsQTreeLeaf(const struct BH_QTreeNode* node);
@@ -11,7 +11,9 @@
 #define SPNG_STATIC
 #include <spng.h>
 
-#include "../res/built_assets.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
 #include "error_macro.h"
 
 static bool CompileShader(GLuint shader, const GLchar* src) {
@@ -122,12 +124,14 @@ static void* LoadPNG(void* png_data, size_t size, size_t* width, size_t* height)
     err = spng_set_png_buffer(ctx, png_data, size);
     if (err) {
         error("spng_set_png_buffer: %s", spng_strerror(err));
+        spng_ctx_free(ctx);
         return NULL;
     }
 
     err = spng_get_ihdr(ctx, &ihdr);
     if (err) {
         error("Failed to read PNG header: %s", spng_strerror(err));
+        spng_ctx_free(ctx);
         return NULL;
     }
 
@@ -135,18 +139,22 @@ static void* LoadPNG(void* png_data, size_t size, size_t* width, size_t* height)
     err = spng_decoded_image_size(ctx, SPNG_FMT_RGBA8, &decoded_size);
     if (err) {
         error("Failed to read image size: %s", spng_strerror(err));
+        spng_ctx_free(ctx);
         return NULL;
     }
 
     void* decoded_image = malloc(decoded_size);
     if (decoded_image == NULL) {
         error("Failed to allocate memory");
+        spng_ctx_free(ctx);
         return NULL;
     }
 
     err = spng_decode_image(ctx, decoded_image, decoded_size, SPNG_FMT_RGBA8, 0);
     if (err) {
         error("Failed to decode image: %s", spng_strerror(err));
+        free(decoded_image);
+        spng_ctx_free(ctx);
         return NULL;
     }
 
@@ -158,7 +166,9 @@ static void* LoadPNG(void* png_data, size_t size, size_t* width, size_t* height)
     return decoded_image;
 }
 
-static GLuint UploadTexture(void* image, size_t width, size_t height) {
+/* Sampling is GL_NEAREST, so a single level is all that is ever read and
+ * no mip chain is allocated */
+static GLuint UploadTexture(const void* image, size_t width, size_t height) {
     GLuint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
@@ -168,8 +178,8 @@ static GLuint UploadTexture(void* image, size_t width, size_t height) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image);
 
     return texture;
 }
@@ -190,52 +200,257 @@ static GLuint CreateTexture(void* png_data, size_t size) {
     return texture;
 }
 
-static GLuint64 AppendTextureHandle(struct BH_Textures* textures, GLuint texture) {
+static bool AppendTextureHandle(struct BH_Textures* textures, GLuint texture, uint32_t* index) {
     if (!texture) {
         error("texture == 0");
-        return 0;
+        return false;
     }
     if (textures->count >= BH_MAX_TEXTURES) {
         error("Couldn't load texture, textures->count exceeds BH_MAX_TEXTURES");
-        return 0;
+        return false;
     }
 
     GLuint64 texture_handle = glGetTextureHandleARB(texture);
 
     if (!texture_handle) {
         error("glGetTextureHandleARB returned NULL");
-        return 0;
+        return false;
     }
 
     glMakeTextureHandleResidentARB(texture_handle);
 
     textures->texture_ids[textures->count] = texture;
     textures->texture_handles[textures->count] = texture_handle;
-    textures->count++;
+    *index = textures->count++;
 
-    return texture_handle;
+    return true;
 }
 
-GLuint64 BH_LoadTexture(struct BH_Textures* textures, void* png_data, size_t size) {
-    GLuint texture = CreateTexture(png_data, size);
-    if (!texture) {
-        error("Couldn't create texture");
-        return 0;
+/* Returns the region's index, or BH_NO_TEXTURE on failure */
+static uint16_t
+AddRegion(struct BH_Textures* textures, uint32_t texture, float u0, float v0, float u1, float v1) {
+    if (textures->region_count >= BH_MAX_REGIONS) {
+        error("Couldn't add region, textures->region_count exceeds BH_MAX_REGIONS");
+        return BH_NO_TEXTURE;
     }
 
-    GLuint64 texture_handle = AppendTextureHandle(textures, texture);
-    if (!texture_handle) {
-        return 0;
+    textures->regions[textures->region_count] = (struct BH_TextureRegion){
+        .u0 = u0,
+        .v0 = v0,
+        .u1 = u1,
+        .v1 = v1,
+        .texture = texture,
+    };
+
+    return textures->region_count++;
+}
+
+uint16_t BH_LoadTexture(struct BH_Textures* textures, void* png_data, size_t size) {
+    uint32_t texture = 0;
+
+    if (!textures->headless) {
+        GLuint texture_id = CreateTexture(png_data, size);
+        if (!texture_id) {
+            error("Couldn't create texture");
+            return BH_NO_TEXTURE;
+        }
+
+        if (!AppendTextureHandle(textures, texture_id, &texture)) {
+            return BH_NO_TEXTURE;
+        }
+    }
+
+    return AddRegion(textures, texture, 0.0f, 0.0f, 1.0f, 1.0f);
+}
+
+/* Returns a region covering all of the new texture */
+static uint16_t AddTexture(
+    struct BH_Textures* textures, const void* pixels, size_t width, size_t height
+) {
+    uint32_t texture = 0;
+
+    if (!textures->headless) {
+        GLuint texture_id = UploadTexture(pixels, width, height);
+        if (!AppendTextureHandle(textures, texture_id, &texture)) {
+            return BH_NO_TEXTURE;
+        }
+    }
+
+    return AddRegion(textures, texture, 0.0f, 0.0f, 1.0f, 1.0f);
+}
+
+uint16_t BH_LoadTextureAsset(
+    struct BH_Textures* textures, const struct BH_AssetPack* assets, const char* name
+) {
+    size_t size;
+    const struct BH_PackTexture* header = BH_GetAsset(assets, name, BH_ASSET_TEXTURE, &size);
+    if (header == NULL ||
+        size != sizeof(*header) + (size_t)header->width * header->height * 4) {
+        error("Couldn't load texture `%s`", name);
+        return BH_NO_TEXTURE;
+    }
+
+    return AddTexture(textures, header + 1, header->width, header->height);
+}
+
+struct DecodeJob {
+    void* png_data;
+    size_t size;
+    void* pixels;
+    size_t width, height;
+};
+
+static void DecodePNG(void* data) {
+    struct DecodeJob* job = data;
+    job->pixels = LoadPNG(job->png_data, job->size, &job->width, &job->height);
+}
+
+bool BH_LoadTextures(
+    struct BH_Textures* textures, struct BH_JobPool* jobs, void* const* png_data,
+    const size_t* sizes, size_t count, uint16_t* regions
+) {
+    if (textures->headless) {
+        for (size_t i = 0; i < count; i++) {
+            regions[i] = AddRegion(textures, 0, 0.0f, 0.0f, 1.0f, 1.0f);
+        }
+        return true;
+    }
+
+    struct DecodeJob* decode_jobs = calloc(count, sizeof(struct DecodeJob));
+    if (count && decode_jobs == NULL) {
+        error("Failed to allocate memory");
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        decode_jobs[i] = (struct DecodeJob){ .png_data = png_data[i], .size = sizes[i] };
+        if (!BH_PushJob(jobs, DecodePNG, &decode_jobs[i])) {
+            DecodePNG(&decode_jobs[i]);
+        }
     }
 
-    return texture_handle;
+    BH_WaitJobs(jobs);
+
+    /* GL calls only on this thread, in the order the images were given */
+    bool loaded = true;
+    for (size_t i = 0; i < count; i++) {
+        struct DecodeJob* job = &decode_jobs[i];
+        regions[i] = BH_NO_TEXTURE;
+
+        if (job->pixels == NULL) {
+            error("Couldn't load image %zu", i);
+            loaded = false;
+            continue;
+        }
+
+        regions[i] = AddTexture(textures, job->pixels, job->width, job->height);
+        loaded &= regions[i] != BH_NO_TEXTURE;
+        free(job->pixels);
+    }
+
+    free(decode_jobs);
+    return loaded;
+}
+
+static int CompareRegionName(const void* name, const void* region) {
+    return strcmp(name, ((const struct BH_PackRegion*)region)->name);
 }
 
-void BH_DeinitTextures(struct BH_Textures textures) {
-    for (size_t i = 0; i < textures.count; i++) {
-        glMakeTextureHandleNonResidentARB(textures.texture_handles[i]);
+uint16_t BH_GetAtlasRegion(const struct BH_Textures* textures, const char* name) {
+    const struct BH_PackRegion* region = bsearch(
+        name, textures->atlas_regions, textures->atlas_region_count, sizeof(struct BH_PackRegion),
+        CompareRegionName
+    );
+
+    if (region == NULL) {
+        error("No image `%s` in the atlas", name);
+        return BH_NO_TEXTURE;
     }
-    glDeleteTextures(textures.count, (const GLuint*)&textures.texture_ids);
+
+    return textures->atlas_first_region + (region - textures->atlas_regions);
+}
+
+/* Takes up region BH_NO_TEXTURE, so it must be the first region added */
+static bool InitWhiteTexture(struct BH_Textures* textures) {
+    uint32_t texture = 0;
+
+    if (!textures->headless) {
+        uint8_t white[4] = { 255, 255, 255, 255 };
+        if (!AppendTextureHandle(textures, UploadTexture(white, 1, 1), &texture)) {
+            error("Couldn't create white texture");
+            return false;
+        }
+    }
+
+    AddRegion(textures, texture, 0.0f, 0.0f, 1.0f, 1.0f);
+
+    return true;
+}
+
+/* Headless, only the region table is read and the pages stay on disk */
+static bool LoadAtlas(struct BH_Textures* textures, const struct BH_AssetPack* assets) {
+    size_t size;
+    const struct BH_PackAtlas* atlas = BH_GetAsset(assets, BH_ATLAS_ASSET, BH_ASSET_ATLAS, &size);
+    if (atlas == NULL ||
+        size < sizeof(*atlas) + atlas->region_count * sizeof(struct BH_PackRegion)) {
+        error("Couldn't load the atlas");
+        return false;
+    }
+
+    uint32_t first_page = textures->count;
+    size_t page_bytes = (size_t)atlas->page_size * atlas->page_size * 4;
+
+    for (uint32_t i = 0; i < atlas->page_count && !textures->headless; i++) {
+        char name[BH_ASSET_NAME_SIZE];
+        snprintf(name, sizeof(name), BH_ATLAS_PAGE_ASSET, i);
+
+        const void* pixels = BH_GetAsset(assets, name, BH_ASSET_ATLAS_PAGE, &size);
+        if (pixels == NULL || size != page_bytes) {
+            error("Couldn't load atlas page %u", i);
+            return false;
+        }
+
+        GLuint page = UploadTexture(pixels, atlas->page_size, atlas->page_size);
+
+        uint32_t texture;
+        if (!AppendTextureHandle(textures, page, &texture)) {
+            error("Couldn't upload atlas page %u", i);
+            return false;
+        }
+    }
+
+    textures->atlas_first_region = textures->region_count;
+    textures->atlas_regions = (const struct BH_PackRegion*)(atlas + 1);
+    textures->atlas_region_count = atlas->region_count;
+
+    for (size_t i = 0; i < textures->atlas_region_count; i++) {
+        struct BH_PackRegion region = textures->atlas_regions[i];
+        if (AddRegion(
+                textures, first_page + region.page, region.u0, region.v0, region.u1, region.v1
+            ) == BH_NO_TEXTURE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void BH_DeinitTextures(struct BH_Textures* textures) {
+    if (textures->headless) {
+        return;
+    }
+
+    /* Streamed textures not swapped in yet only borrow a handle */
+    for (size_t i = 0; i < textures->count; i++) {
+        if (textures->texture_ids[i]) {
+            glMakeTextureHandleNonResidentARB(textures->texture_handles[i]);
+        }
+    }
+    glDeleteTextures(textures->count, textures->texture_ids);
+}
+
+uint32_t BH_PackColour(struct BH_Colour colour) {
+    return pack_unorm4x8(colour.r, colour.g, colour.b, colour.a);
 }
 
 static GLuint CreateSSBO(const void* buffer, size_t size) {
@@ -258,61 +473,188 @@ static const GLfloat QUAD_VERTICES[] = {
 };
 // clang-format on
 
+#define RING_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+static bool MapRing(struct BH_SpriteBatch* batch, size_t region_size) {
+    GLsizeiptr ring_size = BH_BATCH_FRAMES * region_size * sizeof(struct BH_Sprite);
+
+    GLuint ssbo;
+    glCreateBuffers(1, &ssbo);
+    glNamedBufferStorage(ssbo, ring_size, NULL, RING_FLAGS);
+
+    struct BH_Sprite* instances = glMapNamedBufferRange(ssbo, 0, ring_size, RING_FLAGS);
+    if (instances == NULL) {
+        error("Failed to map sprite instance buffer");
+        glDeleteBuffers(1, &ssbo);
+        return false;
+    }
+
+    batch->instances_ssbo = ssbo;
+    batch->instances = instances;
+    batch->region_size = region_size;
+    batch->region = 0;
+
+    return true;
+}
+
+static void UnmapRing(struct BH_SpriteBatch* batch) {
+    if (batch->instances) {
+        glUnmapNamedBuffer(batch->instances_ssbo);
+    }
+    glDeleteBuffers(1, &batch->instances_ssbo);
+
+    batch->instances = NULL;
+}
+
 struct BH_SpriteBatch BH_InitBatch(void) {
     struct BH_SpriteBatch res = { 0 };
 
     res.mesh = BH_UploadMesh(QUAD_VERTICES, sizeof(QUAD_VERTICES) / sizeof(QUAD_VERTICES[0]));
-    res.instances_ssbo = CreateSSBO(res.instance_data, sizeof(res.instance_data));
-    res.textures_ssbo = CreateSSBO(res.instance_textures, sizeof(res.instance_textures));
+    res.textures_ssbo = CreateSSBO(NULL, BH_MAX_TEXTURES * sizeof(GLuint64));
+    res.regions_ssbo = CreateSSBO(NULL, BH_MAX_REGIONS * sizeof(struct BH_TextureRegion));
+
+    MapRing(&res, BH_BATCH_START_SIZE);
 
     return res;
 }
 
 void BH_DeinitBatch(struct BH_SpriteBatch batch) {
+    for (size_t i = 0; i < BH_BATCH_FRAMES; i++) {
+        if (batch.fences[i]) {
+            glDeleteSync(batch.fences[i]);
+        }
+    }
+    UnmapRing(&batch);
     glDeleteBuffers(1, &batch.textures_ssbo);
-    glDeleteBuffers(1, &batch.instances_ssbo);
+    glDeleteBuffers(1, &batch.regions_ssbo);
 }
 
-void BH_RenderBatch(struct BH_Renderer* renderer, struct BH_Sprite sprite) {
+/* Blocks until the GPU has finished the draws that read `fence`'s region */
+static void WaitForFence(GLsync fence) {
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (glClientWaitSync(fence, flags, 1000000) == GL_TIMEOUT_EXPIRED) {
+        flags = 0;
+    }
+    glDeleteSync(fence);
+}
+
+/* Both tables are only ever appended to, so only new entries are uploaded */
+static void UploadTextureTables(struct BH_Renderer* renderer) {
     struct BH_SpriteBatch* batch = &renderer->batch;
-    /* Insert sprite data into batch array */
-    memcpy(batch->instance_data[batch->count].transform, sprite.transform, sizeof(m4));
-    batch->instance_data[batch->count].flags = sprite.flags;
-    batch->instance_data[batch->count].colour = sprite.colour;
-    batch->instance_textures[batch->count] = sprite.texture_handle;
-    batch->count++;
+    struct BH_Textures* textures = &renderer->textures;
 
-    /* Draw the batch when it is full */
-    if (batch->count >= BH_BATCH_SIZE) {
-        BH_FinishBatch(renderer);
+    if (batch->uploaded_textures != textures->count) {
+        size_t first = batch->uploaded_textures;
+        size_t size = (textures->count - first) * sizeof(GLuint64);
+
+        glNamedBufferSubData(
+            batch->textures_ssbo, first * sizeof(GLuint64), size, &textures->texture_handles[first]
+        );
+        renderer->stats.bytes_uploaded += size;
+        batch->uploaded_textures = textures->count;
     }
-}
 
-static void BatchDrawcall(struct BH_Renderer* renderer) {
-    glBindVertexArray(renderer->batch.mesh.vao_handle);
-    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, renderer->batch.count);
+    if (batch->uploaded_regions != textures->region_count) {
+        size_t first = batch->uploaded_regions;
+        size_t size = (textures->region_count - first) * sizeof(struct BH_TextureRegion);
+
+        glNamedBufferSubData(
+            batch->regions_ssbo, first * sizeof(struct BH_TextureRegion), size,
+            &textures->regions[first]
+        );
+        renderer->stats.bytes_uploaded += size;
+        batch->uploaded_regions = textures->region_count;
+    }
 }
 
-void BH_FinishBatch(struct BH_Renderer* renderer) {
+static void DrawBatch(struct BH_Renderer* renderer) {
     struct BH_SpriteBatch* batch = &renderer->batch;
-    /* Sync SSBO contents */
-    glNamedBufferSubData(
-        batch->instances_ssbo, 0, batch->count * sizeof(struct BH_InstanceData),
-        batch->instance_data
-    );
-    glNamedBufferSubData(
-        batch->textures_ssbo, 0, batch->count * sizeof(GLuint64), batch->instance_textures
+    if (batch->count == batch->first) {
+        return;
+    }
+
+    UploadTextureTables(renderer);
+
+    /* vertex.glsl offsets gl_InstanceID by the base instance, so the ring
+     * stays bound as a whole */
+    glBindVertexArray(batch->mesh.vao_handle);
+    glDrawArraysInstancedBaseInstance(
+        GL_TRIANGLE_FAN, 0, 4, batch->count - batch->first,
+        batch->region * batch->region_size + batch->first
     );
 
-    /* Make sure SSBOs are bound */
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, batch->instances_ssbo);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, batch->textures_ssbo);
+    renderer->stats.sprites += batch->count - batch->first;
+    renderer->stats.draw_calls++;
+    renderer->stats.bytes_uploaded += (batch->count - batch->first) * sizeof(struct BH_Sprite);
+
+    batch->first = batch->count;
+}
+
+static void NextRegion(struct BH_SpriteBatch* batch) {
+    batch->fences[batch->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    batch->region = (batch->region + 1) % BH_BATCH_FRAMES;
+
+    if (batch->fences[batch->region]) {
+        WaitForFence(batch->fences[batch->region]);
+        batch->fences[batch->region] = NULL;
+    }
+
+    batch->first = 0;
+    batch->count = 0;
+}
+
+/* For a frame with more sprites than a region holds. What the frame has so
+ * far is drawn right away, then the ring is replaced by one twice the size
+ * once the GPU is done with it. */
+static void GrowBatch(struct BH_Renderer* renderer) {
+    struct BH_SpriteBatch* batch = &renderer->batch;
+
+    DrawBatch(renderer);
+    batch->fences[batch->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
-    /* Draw call */
-    BatchDrawcall(renderer);
+    for (size_t i = 0; i < BH_BATCH_FRAMES; i++) {
+        if (batch->fences[i]) {
+            WaitForFence(batch->fences[i]);
+            batch->fences[i] = NULL;
+        }
+    }
 
-    /* Reset batch state */
+    batch->first = 0;
     batch->count = 0;
+
+    /* On failure the old ring, which is idle now, is simply reused */
+    struct BH_SpriteBatch grown = *batch;
+    if (MapRing(&grown, batch->region_size * 2)) {
+        UnmapRing(batch);
+        *batch = grown;
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, batch->instances_ssbo);
+    }
+}
+
+void BH_RenderBatch(struct BH_Renderer* renderer, struct BH_Sprite sprite) {
+    if (renderer->headless) {
+        renderer->stats.sprites++;
+        return;
+    }
+
+    struct BH_SpriteBatch* batch = &renderer->batch;
+    if (batch->count >= batch->region_size) {
+        GrowBatch(renderer);
+    }
+
+    batch->instances[batch->region * batch->region_size + batch->count++] = sprite;
+}
+
+static void DrawUILayer(struct BH_Renderer* renderer);
+
+void BH_FinishBatch(struct BH_Renderer* renderer) {
+    if (renderer->headless) {
+        return;
+    }
+
+    DrawBatch(renderer);
+    DrawUILayer(renderer);
+    NextRegion(&renderer->batch);
 }
 
 static bool InitGLFW(struct BH_Renderer* renderer) {
@@ -368,16 +710,26 @@ static bool InitGL(struct BH_Renderer* renderer) {
     return true;
 }
 
-static bool InitShaders(struct BH_Renderer* renderer) {
-    renderer->main_program =
-        BH_InitProgram((const GLchar*)ASSET_vertex, (const GLchar*)ASSET_fragment);
+static GLuint LoadProgram(
+    const struct BH_AssetPack* assets, const char* vertex_name, const char* fragment_name
+) {
+    const GLchar* vertex_src = BH_GetAsset(assets, vertex_name, BH_ASSET_SHADER, NULL);
+    const GLchar* fragment_src = BH_GetAsset(assets, fragment_name, BH_ASSET_SHADER, NULL);
+    if (vertex_src == NULL || fragment_src == NULL) {
+        return 0;
+    }
+
+    return BH_InitProgram(vertex_src, fragment_src);
+}
+
+static bool InitShaders(struct BH_Renderer* renderer, const struct BH_AssetPack* assets) {
+    renderer->main_program = LoadProgram(assets, "vertex", "fragment");
     if (!renderer->main_program) {
         error("Couldn't load main shader");
         return false;
     }
 
-    renderer->post_program =
-        BH_InitProgram((const GLchar*)ASSET_vertex_post, (const GLchar*)ASSET_fragment_post);
+    renderer->post_program = LoadProgram(assets, "vertex_post", "fragment_post");
     if (!renderer->post_program) {
         error("Couldn't load post processing shader");
         return false;
@@ -386,7 +738,13 @@ static bool InitShaders(struct BH_Renderer* renderer) {
     return true;
 }
 
-static GLuint UploadGlyphTexture(FT_Bitmap bitmap) {
+/* All glyphs of a font share one GL_RED texture, the smallest power of two
+ * they fit into */
+#define GLYPH_ATLAS_MIN_SIZE 64
+#define GLYPH_ATLAS_MAX_SIZE 2048
+#define GLYPH_PADDING 1
+
+static GLuint UploadGlyphAtlas(const unsigned char* pixels, int size) {
     GLuint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
@@ -396,72 +754,220 @@ static GLuint UploadGlyphTexture(FT_Bitmap bitmap) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-    glTexImage2D(
-        GL_TEXTURE_2D, 0, GL_RED, bitmap.width, bitmap.rows, 0, GL_RED, GL_UNSIGNED_BYTE,
-        bitmap.buffer
-    );
-
-    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, size, size);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RED, GL_UNSIGNED_BYTE, pixels);
 
     return texture;
 }
 
-static void PreloadGlyphs(struct BH_Font* font, FT_Face face) {
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+/* Shelf packing in character order, glyphs are all about the same height.
+ * Returns false if they don't fit into a `size` squared atlas. */
+static bool PackGlyphs(const struct BH_Glyph* glyphs, int size, int* xs, int* ys) {
+    int x = 0, y = 0, shelf_height = 0;
 
-    for (unsigned char ch = 0; ch < MAX_CHARACTER; ch++) {
-        if (FT_Load_Char(face, ch, FT_LOAD_RENDER)) {
-            continue;
+    for (size_t ch = 0; ch < MAX_CHARACTER; ch++) {
+        int width = glyphs[ch].width + 2 * GLYPH_PADDING;
+        int height = glyphs[ch].height + 2 * GLYPH_PADDING;
+
+        if (x + width > size) {
+            x = 0;
+            y += shelf_height;
+            shelf_height = 0;
+        }
+        if (y + height > size) {
+            return false;
         }
 
-        GLuint64 handle = 0;
+        xs[ch] = x + GLYPH_PADDING;
+        ys[ch] = y + GLYPH_PADDING;
 
-        if (face->glyph->bitmap.width != 0) {
-            GLuint texture = UploadGlyphTexture(face->glyph->bitmap);
-            handle = AppendTextureHandle(&font->textures, texture);
+        x += width;
+        if (height > shelf_height) {
+            shelf_height = height;
         }
+    }
+
+    return true;
+}
 
-        font->glyphs[ch] = (struct BH_Glyph){ .texture = handle,
-                                              .width = face->glyph->bitmap.width,
-                                              .height = face->glyph->bitmap.rows,
-                                              .bearing_x = face->glyph->bitmap_left,
-                                              .bearing_y = face->glyph->bitmap_top,
-                                              .advance = face->glyph->advance.x };
+/* Bitmaps are kept tightly packed, `width` bytes per row */
+static void BlitGlyph(
+    unsigned char* pixels, int size, int x, int y, const struct BH_Glyph* glyph,
+    const unsigned char* bitmap
+) {
+    for (int row = 0; row < glyph->height; row++) {
+        memcpy(&pixels[(y + row) * size + x], &bitmap[row * glyph->width], glyph->width);
     }
 }
 
-static bool
-InitFont(FT_Library ft, struct BH_Font* font, size_t font_size, void* data, size_t size) {
+/* The characters [first, end), rasterised on a job thread. FreeType
+ * objects may not be shared between threads, so every job opens the font
+ * on its own. */
+struct GlyphJob {
+    const void* data;
+    size_t size;
+    size_t font_size;
+    size_t first, end;
+    struct BH_Glyph* glyphs;
+    unsigned char** bitmaps;
+    bool failed;
+};
+
+static void RasteriseGlyphs(void* data) {
+    struct GlyphJob* job = data;
+    FT_Library ft;
     FT_Face face;
 
-    if (FT_New_Memory_Face(ft, data, size, 0, &face)) {
+    if (FT_Init_FreeType(&ft)) {
+        error("FreeType initialisation failed");
+        job->failed = true;
+        return;
+    }
+
+    if (FT_New_Memory_Face(ft, job->data, job->size, 0, &face) ||
+        FT_Set_Pixel_Sizes(face, 0, job->font_size)) {
         error("Couldn't load font");
+        job->failed = true;
+        FT_Done_FreeType(ft);
+        return;
+    }
+
+    for (size_t ch = job->first; ch < job->end; ch++) {
+        if (FT_Load_Char(face, ch, FT_LOAD_RENDER)) {
+            job->glyphs[ch] = (struct BH_Glyph){ .texture = BH_NO_TEXTURE };
+            continue;
+        }
+
+        FT_Bitmap bitmap = face->glyph->bitmap;
+        job->glyphs[ch] = (struct BH_Glyph){ .texture = BH_NO_TEXTURE,
+                                             .width = bitmap.width,
+                                             .height = bitmap.rows,
+                                             .bearing_x = face->glyph->bitmap_left,
+                                             .bearing_y = face->glyph->bitmap_top,
+                                             .advance = face->glyph->advance.x };
+
+        if (bitmap.width == 0 || bitmap.rows == 0) {
+            continue;
+        }
+
+        unsigned char* copy = malloc((size_t)bitmap.width * bitmap.rows);
+        if (copy == NULL) {
+            error("Failed to allocate memory");
+            job->failed = true;
+            break;
+        }
+
+        for (unsigned int row = 0; row < bitmap.rows; row++) {
+            memcpy(&copy[row * bitmap.width], &bitmap.buffer[row * bitmap.pitch], bitmap.width);
+        }
+        job->bitmaps[ch] = copy;
+    }
+
+    /* Also closes the face */
+    FT_Done_FreeType(ft);
+}
+
+static void FreeGlyphBitmaps(unsigned char** bitmaps) {
+    for (size_t ch = 0; ch < MAX_CHARACTER; ch++) {
+        free(bitmaps[ch]);
+    }
+}
+
+static bool PackGlyphAtlas(
+    struct BH_Font* font, struct BH_Textures* textures, unsigned char** bitmaps
+) {
+    int xs[MAX_CHARACTER], ys[MAX_CHARACTER];
+    int size = GLYPH_ATLAS_MIN_SIZE;
+    while (!PackGlyphs(font->glyphs, size, xs, ys)) {
+        size *= 2;
+        if (size > GLYPH_ATLAS_MAX_SIZE) {
+            error("Glyphs don't fit into a %d pixel atlas", GLYPH_ATLAS_MAX_SIZE);
+            return false;
+        }
+    }
+
+    unsigned char* pixels = calloc((size_t)size * size, 1);
+    if (pixels == NULL) {
+        error("Failed to allocate memory");
         return false;
     }
 
-    if (FT_Set_Pixel_Sizes(face, 0, font_size)) {
-        error("Couldn't set font size");
+    for (size_t ch = 0; ch < MAX_CHARACTER; ch++) {
+        if (bitmaps[ch] != NULL) {
+            BlitGlyph(pixels, size, xs[ch], ys[ch], &font->glyphs[ch], bitmaps[ch]);
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLuint atlas = UploadGlyphAtlas(pixels, size);
+    free(pixels);
+
+    uint32_t texture;
+    if (!AppendTextureHandle(textures, atlas, &texture)) {
+        error("Couldn't upload glyph atlas");
         return false;
     }
 
-    PreloadGlyphs(font, face);
+    for (size_t ch = 0; ch < MAX_CHARACTER; ch++) {
+        struct BH_Glyph* glyph = &font->glyphs[ch];
+        if (bitmaps[ch] == NULL) {
+            continue;
+        }
 
-    FT_Done_Face(face);
+        glyph->texture = AddRegion(
+            textures, texture, (float)xs[ch] / size, (float)ys[ch] / size,
+            (float)(xs[ch] + glyph->width) / size, (float)(ys[ch] + glyph->height) / size
+        );
+    }
 
     return true;
 }
 
-static void DeinitFont(struct BH_Font font) { BH_DeinitTextures(font.textures); }
-
-static bool InitFreeType(struct BH_Renderer* renderer) {
-    if (FT_Init_FreeType(&renderer->ft)) {
-        error("FreeType initialisation failed");
+/* Glyphs are rasterised on `jobs`, a share for each of its threads and the
+ * one waiting, and only the atlas is uploaded here */
+static bool InitFont(
+    struct BH_Font* font, struct BH_Textures* textures, struct BH_JobPool* jobs, size_t font_size,
+    const void* data, size_t size
+) {
+    unsigned char* bitmaps[MAX_CHARACTER] = { 0 };
+    size_t job_count = jobs->thread_count + 1;
+    struct GlyphJob* glyph_jobs = calloc(job_count, sizeof(struct GlyphJob));
+    if (glyph_jobs == NULL) {
+        error("Failed to allocate memory");
         return false;
     }
-    return true;
-}
+    size_t per_job = (MAX_CHARACTER + job_count - 1) / job_count;
+
+    for (size_t i = 0; i < job_count; i++) {
+        size_t first = i * per_job;
+        glyph_jobs[i] = (struct GlyphJob){
+            .data = data,
+            .size = size,
+            .font_size = font_size,
+            .first = first,
+            .end = first + per_job < MAX_CHARACTER ? first + per_job : MAX_CHARACTER,
+            .glyphs = font->glyphs,
+            .bitmaps = bitmaps,
+        };
+
+        if (!BH_PushJob(jobs, RasteriseGlyphs, &glyph_jobs[i])) {
+            RasteriseGlyphs(&glyph_jobs[i]);
+        }
+    }
+
+    BH_WaitJobs(jobs);
+
+    bool loaded = true;
+    for (size_t i = 0; i < job_count; i++) {
+        loaded &= !glyph_jobs[i].failed;
+    }
+    free(glyph_jobs);
 
-static void DeinitFreeType(FT_Library ft) { FT_Done_FreeType(ft); }
+    loaded = loaded && PackGlyphAtlas(font, textures, bitmaps);
+
+    FreeGlyphBitmaps(bitmaps);
+    return loaded;
+}
 
 static void UpdateProjectionMatrix(struct BH_Renderer* renderer) {
     m4_ortho(
@@ -474,12 +980,12 @@ static void UpdateProjectionMatrix(struct BH_Renderer* renderer) {
     );
 }
 
-static void InitFramebufferColorAttachment(struct BH_Framebuffer* framebuffer) {
+static void InitFramebufferColorAttachment(struct BH_Framebuffer* framebuffer, GLenum format) {
     glGenTextures(1, &framebuffer->color_buffer);
     glBindTexture(GL_TEXTURE_2D, framebuffer->color_buffer);
 
     glTexImage2D(
-        GL_TEXTURE_2D, 0, GL_RGB, framebuffer->width, framebuffer->height, 0, GL_RGB,
+        GL_TEXTURE_2D, 0, format, framebuffer->width, framebuffer->height, 0, format,
         GL_UNSIGNED_BYTE, NULL
     );
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -505,14 +1011,15 @@ static void InitFramebufferDepthStencil(struct BH_Framebuffer* framebuffer) {
     );
 }
 
-static bool InitFramebuffer(struct BH_Framebuffer* framebuffer, int width, int height) {
+static bool
+InitFramebuffer(struct BH_Framebuffer* framebuffer, int width, int height, GLenum format) {
     framebuffer->width = width;
     framebuffer->height = height;
 
     glGenFramebuffers(1, &framebuffer->fbo);
     glBindFramebuffer(GL_FRAMEBUFFER, framebuffer->fbo);
 
-    InitFramebufferColorAttachment(framebuffer);
+    InitFramebufferColorAttachment(framebuffer, format);
     InitFramebufferDepthStencil(framebuffer);
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
@@ -535,24 +1042,438 @@ static void DeinitFramebuffer(struct BH_Framebuffer framebuffer) {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-bool BH_InitRenderer(struct BH_Renderer* renderer) {
-    assert(sizeof(struct BH_InstanceData) % 16 == 0);
+static bool InitUILayer(struct BH_Renderer* renderer) {
+    struct BH_UILayer* ui = &renderer->ui;
+
+    if (!InitFramebuffer(&ui->framebuffer, renderer->width, renderer->height, GL_RGBA)) {
+        return false;
+    }
+
+    if (!AppendTextureHandle(&renderer->textures, ui->framebuffer.color_buffer, &ui->texture)) {
+        error("Couldn't create UI layer texture");
+        return false;
+    }
+
+    /* Framebuffer rows go bottom to top */
+    ui->region = AddRegion(&renderer->textures, ui->texture, 0.0f, 1.0f, 1.0f, 0.0f);
+    ui->dirty = true;
+
+    return true;
+}
+
+/* The GPU must be done with the old texture, as its handle is made
+ * non-resident right away. On failure the layer is left without a
+ * framebuffer and isn't drawn until a later resize succeeds. */
+static bool ResizeUILayer(struct BH_Renderer* renderer) {
+    struct BH_UILayer* ui = &renderer->ui;
+    struct BH_Textures* textures = &renderer->textures;
+
+    glFinish();
+    if (ui->framebuffer.fbo != 0) {
+        glMakeTextureHandleNonResidentARB(textures->texture_handles[ui->texture]);
+    }
+    DeinitFramebuffer(ui->framebuffer);
+
+    if (!InitFramebuffer(&ui->framebuffer, renderer->width, renderer->height, GL_RGBA)) {
+        DeinitFramebuffer(ui->framebuffer);
+        ui->framebuffer = (struct BH_Framebuffer){ 0 };
+        textures->texture_ids[ui->texture] = 0;
+        textures->texture_handles[ui->texture] = 0;
+        return false;
+    }
+
+    GLuint64 texture_handle = glGetTextureHandleARB(ui->framebuffer.color_buffer);
+    glMakeTextureHandleResidentARB(texture_handle);
+
+    textures->texture_ids[ui->texture] = ui->framebuffer.color_buffer;
+    textures->texture_handles[ui->texture] = texture_handle;
+
+    /* Upload the table again from the replaced entry on */
+    if (renderer->batch.uploaded_textures > ui->texture) {
+        renderer->batch.uploaded_textures = ui->texture;
+    }
+
+    ui->dirty = true;
+    return true;
+}
+
+static void DrawUILayer(struct BH_Renderer* renderer) {
+    struct BH_UILayer* ui = &renderer->ui;
+    if (ui->count == 0 || ui->framebuffer.fbo == 0) {
+        return;
+    }
+
+    glDisable(GL_DEPTH_TEST);
+
+    if (ui->dirty) {
+        glBindFramebuffer(GL_FRAMEBUFFER, ui->framebuffer.fbo);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        /* Leaves the layer premultiplied, with the right alpha to composite */
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+        for (size_t i = 0; i < ui->count; i++) {
+            struct BH_UIText* text = &ui->texts[i];
+            BH_RenderText(renderer, text->x, text->y, text->scale, text->colour, text->text);
+        }
+        DrawBatch(renderer);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, renderer->framebuffer.fbo);
+        ui->dirty = false;
+    }
+
+    struct BH_Sprite layer = {
+        .position = { (1.0f + renderer->width) / 2.0f, (1.0f + renderer->height) / 2.0f },
+        .half_size = { (renderer->width - 1.0f) / 2.0f, (renderer->height - 1.0f) / 2.0f },
+        .rotation = pack_snorm2x16(1.0f, 0.0f),
+        .texture = ui->region,
+    };
+
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    BH_RenderBatch(renderer, layer);
+    DrawBatch(renderer);
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_DEPTH_TEST);
+}
+
+static char* CopyString(const char* string) {
+    size_t size = strlen(string) + 1;
+    char* copy = malloc(size);
+    if (copy != NULL) {
+        memcpy(copy, string, size);
+    }
+    return copy;
+}
+
+size_t BH_AddUIText(
+    struct BH_Renderer* renderer, float x, float y, float scale, struct BH_Colour colour,
+    const char* text
+) {
+    struct BH_UILayer* ui = &renderer->ui;
+
+    if (ui->count >= ui->capacity) {
+        size_t capacity = ui->capacity ? ui->capacity * 2 : 8;
+        struct BH_UIText* texts = realloc(ui->texts, capacity * sizeof(struct BH_UIText));
+        if (texts == NULL) {
+            error("Failed to allocate memory");
+            return BH_INVALID_UI_TEXT;
+        }
+        ui->texts = texts;
+        ui->capacity = capacity;
+    }
+
+    char* copy = CopyString(text);
+    if (copy == NULL) {
+        error("Failed to allocate memory");
+        return BH_INVALID_UI_TEXT;
+    }
+
+    ui->texts[ui->count] = (struct BH_UIText){
+        .x = x,
+        .y = y,
+        .scale = scale,
+        .colour = colour,
+        .text = copy,
+    };
+    ui->dirty = true;
+
+    return ui->count++;
+}
+
+void BH_SetUIText(struct BH_Renderer* renderer, size_t id, const char* text) {
+    struct BH_UILayer* ui = &renderer->ui;
+    if (id >= ui->count || strcmp(ui->texts[id].text, text) == 0) {
+        return;
+    }
+
+    char* copy = CopyString(text);
+    if (copy == NULL) {
+        error("Failed to allocate memory");
+        return;
+    }
+
+    free(ui->texts[id].text);
+    ui->texts[id].text = copy;
+    ui->dirty = true;
+}
+
+static bool InitStreamer(struct BH_TextureStreamer* streamer, struct BH_JobPool* jobs) {
+    *streamer = (struct BH_TextureStreamer){ .jobs = jobs };
+
+    if (pthread_mutex_init(&streamer->lock, NULL)) {
+        error("Failed to initialise texture streamer");
+        return false;
+    }
+
+    GLsizeiptr ring_size = BH_STREAM_BUFFERS * BH_STREAM_BUFFER_SIZE;
+    glCreateBuffers(1, &streamer->pbo);
+    glNamedBufferStorage(streamer->pbo, ring_size, NULL, RING_FLAGS);
+
+    streamer->buffers = glMapNamedBufferRange(streamer->pbo, 0, ring_size, RING_FLAGS);
+    if (streamer->buffers == NULL) {
+        error("Failed to map texture streaming buffer");
+        return false;
+    }
+
+    return true;
+}
+
+static void DecodeStream(void* data) {
+    struct BH_TextureStream* stream = data;
+    size_t width, height;
+    void* pixels = LoadPNG(stream->png_data, stream->size, &width, &height);
+
+    pthread_mutex_lock(&stream->streamer->lock);
+    stream->pixels = pixels;
+    stream->width = width;
+    stream->height = height;
+    stream->state = pixels ? BH_STREAM_DECODED : BH_STREAM_FAILED;
+    pthread_mutex_unlock(&stream->streamer->lock);
+}
+
+uint16_t BH_LoadTextureAsync(struct BH_Renderer* renderer, void* png_data, size_t size) {
+    struct BH_Textures* textures = &renderer->textures;
+    struct BH_TextureStreamer* streamer = &renderer->streamer;
+
+    if (textures->headless) {
+        return AddRegion(textures, 0, 0.0f, 0.0f, 1.0f, 1.0f);
+    }
+
+    if (textures->count >= BH_MAX_TEXTURES) {
+        error("Couldn't load texture, textures->count exceeds BH_MAX_TEXTURES");
+        return BH_NO_TEXTURE;
+    }
+
+    if (streamer->count >= streamer->capacity) {
+        size_t capacity = streamer->capacity ? streamer->capacity * 2 : 16;
+        struct BH_TextureStream** grown =
+            realloc(streamer->streams, capacity * sizeof(struct BH_TextureStream*));
+        if (grown == NULL) {
+            error("Failed to allocate memory");
+            return BH_NO_TEXTURE;
+        }
+        streamer->streams = grown;
+        streamer->capacity = capacity;
+    }
+
+    struct BH_TextureStream* stream = malloc(sizeof(struct BH_TextureStream));
+    if (stream == NULL) {
+        error("Failed to allocate memory");
+        return BH_NO_TEXTURE;
+    }
+
+    /* Shares the white texture's handle, but not its id, until swapped */
+    uint32_t placeholder = textures->regions[BH_NO_TEXTURE].texture;
+    uint32_t texture = textures->count;
+    uint16_t region = AddRegion(textures, texture, 0.0f, 0.0f, 1.0f, 1.0f);
+    if (region == BH_NO_TEXTURE) {
+        free(stream);
+        return BH_NO_TEXTURE;
+    }
+
+    textures->texture_ids[texture] = 0;
+    textures->texture_handles[texture] = textures->texture_handles[placeholder];
+    textures->count++;
+
+    *stream = (struct BH_TextureStream){
+        .streamer = streamer,
+        .texture = texture,
+        .png_data = png_data,
+        .size = size,
+        .state = BH_STREAM_DECODING,
+    };
+    streamer->streams[streamer->count++] = stream;
+
+    if (!BH_PushJob(streamer->jobs, DecodeStream, stream)) {
+        DecodeStream(stream);
+    }
+
+    return region;
+}
+
+/* Leaves the stream decoded if every buffer is still in use */
+static void StartStreamUpload(struct BH_Renderer* renderer, struct BH_TextureStream* stream) {
+    struct BH_TextureStreamer* streamer = &renderer->streamer;
+    size_t bytes = stream->width * stream->height * 4;
+
+    stream->buffer = BH_STREAM_BUFFERS;
+    if (bytes <= BH_STREAM_BUFFER_SIZE) {
+        for (size_t i = 0; i < BH_STREAM_BUFFERS; i++) {
+            if (!streamer->buffer_busy[i]) {
+                stream->buffer = i;
+                break;
+            }
+        }
+        if (stream->buffer == BH_STREAM_BUFFERS) {
+            return;
+        }
+    }
+
+    if (stream->buffer != BH_STREAM_BUFFERS) {
+        size_t offset = stream->buffer * BH_STREAM_BUFFER_SIZE;
+        memcpy(&streamer->buffers[offset], stream->pixels, bytes);
+        streamer->buffer_busy[stream->buffer] = true;
+
+        /* With a PBO bound, the pixel pointer is an offset into it */
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, streamer->pbo);
+        stream->texture_id =
+            UploadTexture((const void*)(uintptr_t)offset, stream->width, stream->height);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        /* Larger than a buffer, so the driver copies it out right away */
+        stream->texture_id = UploadTexture(stream->pixels, stream->width, stream->height);
+    }
+
+    free(stream->pixels);
+    stream->pixels = NULL;
+
+    stream->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    stream->state = BH_STREAM_UPLOADING;
+    renderer->stats.bytes_uploaded += bytes;
+}
+
+/* Returns false while the GPU is still copying the pixels */
+static bool FinishStreamUpload(struct BH_Renderer* renderer, struct BH_TextureStream* stream) {
+    struct BH_TextureStreamer* streamer = &renderer->streamer;
+    struct BH_Textures* textures = &renderer->textures;
+
+    GLenum status = glClientWaitSync(stream->fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        return false;
+    }
+
+    glDeleteSync(stream->fence);
+    stream->fence = NULL;
+    if (stream->buffer != BH_STREAM_BUFFERS) {
+        streamer->buffer_busy[stream->buffer] = false;
+    }
+
+    GLuint64 texture_handle = glGetTextureHandleARB(stream->texture_id);
+    if (!texture_handle) {
+        error("glGetTextureHandleARB returned NULL");
+        glDeleteTextures(1, &stream->texture_id);
+        return true;
+    }
+    glMakeTextureHandleResidentARB(texture_handle);
+
+    textures->texture_ids[stream->texture] = stream->texture_id;
+    textures->texture_handles[stream->texture] = texture_handle;
+
+    /* Upload the table again from the replaced entry on */
+    if (renderer->batch.uploaded_textures > stream->texture) {
+        renderer->batch.uploaded_textures = stream->texture;
+    }
+
+    return true;
+}
+
+/* Moves every stream on by at most one step, without ever blocking */
+static void UpdateStreamer(struct BH_Renderer* renderer) {
+    struct BH_TextureStreamer* streamer = &renderer->streamer;
+
+    for (size_t i = 0; i < streamer->count;) {
+        struct BH_TextureStream* stream = streamer->streams[i];
+
+        pthread_mutex_lock(&streamer->lock);
+        enum BH_StreamState state = stream->state;
+        pthread_mutex_unlock(&streamer->lock);
+
+        bool done = false;
+        switch (state) {
+        case BH_STREAM_DECODING:
+            break;
+        case BH_STREAM_DECODED:
+            StartStreamUpload(renderer, stream);
+            break;
+        case BH_STREAM_UPLOADING:
+            done = FinishStreamUpload(renderer, stream);
+            break;
+        case BH_STREAM_FAILED:
+            /* Keeps showing the placeholder */
+            error("Couldn't load streamed texture %u", stream->texture);
+            done = true;
+            break;
+        }
+
+        if (done) {
+            free(stream);
+            streamer->streams[i] = streamer->streams[--streamer->count];
+        } else {
+            i++;
+        }
+    }
+}
+
+static void DeinitStreamer(struct BH_TextureStreamer* streamer) {
+    /* Decode jobs still write to their streams */
+    BH_WaitJobs(streamer->jobs);
+
+    for (size_t i = 0; i < streamer->count; i++) {
+        struct BH_TextureStream* stream = streamer->streams[i];
+        free(stream->pixels);
+        if (stream->fence) {
+            glDeleteSync(stream->fence);
+            glDeleteTextures(1, &stream->texture_id);
+        }
+        free(stream);
+    }
+    free(streamer->streams);
+
+    if (streamer->buffers) {
+        glUnmapNamedBuffer(streamer->pbo);
+    }
+    glDeleteBuffers(1, &streamer->pbo);
+    pthread_mutex_destroy(&streamer->lock);
+}
+
+static void DeinitUILayer(struct BH_UILayer* ui) {
+    for (size_t i = 0; i < ui->count; i++) {
+        free(ui->texts[i].text);
+    }
+    free(ui->texts);
+}
+
+bool BH_InitRenderer(
+    struct BH_Renderer* renderer, const struct BH_AssetPack* assets, struct BH_JobPool* jobs
+) {
+    assert(sizeof(struct BH_Sprite) == 32);
 
     renderer->width = 1280;
     renderer->height = 720;
 
+    if (renderer->headless) {
+        renderer->textures.headless = true;
+        return InitWhiteTexture(&renderer->textures) && LoadAtlas(&renderer->textures, assets);
+    }
+
     if (!InitGL(renderer))
         return false;
-    if (!InitShaders(renderer))
+    if (!InitShaders(renderer, assets))
         return false;
-    if (!InitFramebuffer(&renderer->framebuffer, renderer->width, renderer->height))
+    if (!InitFramebuffer(&renderer->framebuffer, renderer->width, renderer->height, GL_RGB))
         return false;
-    if (!InitFreeType(renderer))
+    if (!InitWhiteTexture(&renderer->textures))
         return false;
-    if (!InitFont(renderer->ft, &renderer->font, 28, (void*)ASSET_font, sizeof(ASSET_font) - 1))
+    if (!LoadAtlas(&renderer->textures, assets))
+        return false;
+
+    size_t font_size;
+    const void* font = BH_GetAsset(assets, "font", BH_ASSET_FONT, &font_size);
+    if (font == NULL)
+        return false;
+    if (!InitFont(&renderer->font, &renderer->textures, jobs, 28, font, font_size))
+        return false;
+    if (!InitUILayer(renderer))
+        return false;
+    if (!InitStreamer(&renderer->streamer, jobs))
         return false;
 
     renderer->batch = BH_InitBatch();
+    if (!renderer->batch.instances)
+        return false;
     UpdateProjectionMatrix(renderer);
 
     return true;
@@ -562,6 +1483,9 @@ void BH_RenderText(
     struct BH_Renderer* renderer, float x0, float y0, float scale, struct BH_Colour colour,
     const char* text
 ) {
+    uint32_t packed_colour = BH_PackColour(colour);
+    uint32_t no_rotation = pack_snorm2x16(1.0f, 0.0f);
+
     for (size_t i = 0; text[i] != '\0'; i++) {
         unsigned char ch = text[i];
         struct BH_Glyph glyph = renderer->font.glyphs[ch];
@@ -576,16 +1500,15 @@ void BH_RenderText(
         float w = glyph.width * scale;
         float h = glyph.height * scale;
 
-        if (glyph.texture != 0) {
-            struct BH_Sprite sprite;
-            sprite.texture_handle = glyph.texture;
-            sprite.colour = colour;
-            sprite.flags = BH_SPRITE_TEXT | BH_SPRITE_HAS_COLOUR;
-
-            m4 translation;
-            m4_translation(translation, x, y, 0.0f);
-            m4_scale(sprite.transform, w / 2.0, h / 2.0, 1.0f);
-            m4_multiply(sprite.transform, translation);
+        if (glyph.texture != BH_NO_TEXTURE) {
+            struct BH_Sprite sprite = {
+                .position = { x, y },
+                .half_size = { w / 2.0f, h / 2.0f },
+                .rotation = no_rotation,
+                .colour = packed_colour,
+                .texture = glyph.texture,
+                .flags = BH_SPRITE_TEXT | BH_SPRITE_HAS_COLOUR,
+            };
 
             BH_RenderBatch(renderer, sprite);
         }
@@ -595,6 +1518,10 @@ void BH_RenderText(
 }
 
 void BH_RendererBeginFrame(struct BH_Renderer* renderer) {
+    if (renderer->headless) {
+        return;
+    }
+
     int width, height;
     glfwGetFramebufferSize(renderer->window, &width, &height);
 
@@ -602,9 +1529,14 @@ void BH_RendererBeginFrame(struct BH_Renderer* renderer) {
         renderer->width = width;
         renderer->height = height;
         DeinitFramebuffer(renderer->framebuffer);
-        InitFramebuffer(&renderer->framebuffer, renderer->width, renderer->height);
+        InitFramebuffer(&renderer->framebuffer, renderer->width, renderer->height, GL_RGB);
+        if (!ResizeUILayer(renderer)) {
+            error("Couldn't resize UI layer, hiding it");
+        }
     }
 
+    UpdateStreamer(renderer);
+
     /* Setup for rendering to FBO */
     glBindFramebuffer(GL_FRAMEBUFFER, renderer->framebuffer.fbo);
     glViewport(0, 0, renderer->framebuffer.width, renderer->framebuffer.height);
@@ -614,9 +1546,19 @@ void BH_RendererBeginFrame(struct BH_Renderer* renderer) {
 
     glUseProgram(renderer->main_program);
     UpdateProjectionMatrix(renderer);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, renderer->batch.instances_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, renderer->batch.textures_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, renderer->batch.regions_ssbo);
 }
 
 void BH_RendererEndFrame(struct BH_Renderer* renderer) {
+    if (renderer->headless) {
+        renderer->last_frame_stats = renderer->stats;
+        renderer->stats = (struct BH_RenderStats){ 0 };
+        return;
+    }
+
     /* Now render to the screen */
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glViewport(0, 0, renderer->width, renderer->height);
@@ -631,16 +1573,27 @@ void BH_RendererEndFrame(struct BH_Renderer* renderer) {
     glBindVertexArray(renderer->batch.mesh.vao_handle);
     glBindTexture(GL_TEXTURE_2D, renderer->framebuffer.color_buffer);
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    renderer->stats.draw_calls++;
+
+    renderer->last_frame_stats = renderer->stats;
+    renderer->stats = (struct BH_RenderStats){ 0 };
 
     glfwSwapBuffers(renderer->window);
 }
 
 void BH_DeinitRenderer(struct BH_Renderer* renderer) {
-    DeinitFont(renderer->font);
-    DeinitFreeType(renderer->ft);
+    DeinitUILayer(&renderer->ui);
+
+    if (renderer->headless) {
+        return;
+    }
 
+    DeinitStreamer(&renderer->streamer);
     glDeleteFramebuffers(1, &renderer->framebuffer.fbo);
-    BH_DeinitTextures(renderer->textures);
+    /* The UI layer's colour buffer goes with the other textures */
+    glDeleteRenderbuffers(1, &renderer->ui.framebuffer.rbo);
+    glDeleteFramebuffers(1, &renderer->ui.framebuffer.fbo);
+    BH_DeinitTextures(&renderer->textures);
     BH_DeinitBatch(renderer->batch);
     BH_DeinitProgram(renderer->main_program);
 
@@ -4,14 +4,17 @@
 #include <GLFW/glfw3.h>
 #include <glad/gl.h>
 
-#include <ft2build.h>
-#include FT_FREETYPE_H
-
+#include "assets.h"
 #include "entitydef.h"
+#include "jobs.h"
 #include "matrix.h"
 
 #define BH_MAX_TEXTURES 512
-#define BH_BATCH_SIZE 1024
+#define BH_MAX_REGIONS 4096
+/* Frames the GPU may lag behind before BH_FinishBatch waits for it */
+#define BH_BATCH_FRAMES 3
+/* Sprites per region to start with, doubled whenever a frame needs more */
+#define BH_BATCH_START_SIZE 16384
 
 GLuint BH_InitProgram(const GLchar* vertex_src, const GLchar* fragment_src);
 void BH_DeinitProgram(GLuint program);
@@ -23,38 +26,83 @@ struct BH_MeshHandle {
 
 struct BH_MeshHandle BH_UploadMesh(const GLfloat* vertices, size_t count);
 
+/* Part of a texture, matches `struct region` in vertex.glsl */
+struct BH_TextureRegion {
+    float u0, v0, u1, v1;
+    uint32_t texture; /* index into `texture_handles` */
+    uint32_t padding[3];
+};
+
+/* Sprites refer to regions by their index in here. Both tables are
+ * uploaded once, rather than once per sprite, and only ever grow. */
 struct BH_Textures {
     GLuint texture_ids[BH_MAX_TEXTURES];
     GLuint64 texture_handles[BH_MAX_TEXTURES];
     size_t count;
+
+    struct BH_TextureRegion regions[BH_MAX_REGIONS];
+    size_t region_count;
+    /* Region of the first image in the atlas built by asset_builder. The
+     * names of its images point into the asset pack. */
+    size_t atlas_first_region;
+    const struct BH_PackRegion* atlas_regions;
+    size_t atlas_region_count;
+
+    /* Hand out regions only, without decoding or uploading anything */
+    bool headless;
 };
 
-GLuint64 BH_LoadTexture(struct BH_Textures* textures, void* png_data, size_t size);
-void BH_DeinitTextures(struct BH_Textures textures);
+/* Region covering a plain white texture, also returned when loading fails */
+#define BH_NO_TEXTURE 0
+
+/* For images that are not part of the atlas, returns a region covering all
+ * of the new texture. BH_LoadTextureAsset takes the images asset_builder
+ * found too large for the atlas, which are already decoded. BH_LoadTexture
+ * decodes a PNG first. */
+uint16_t BH_LoadTexture(struct BH_Textures* textures, void* png_data, size_t size);
+uint16_t BH_LoadTextureAsset(
+    struct BH_Textures* textures, const struct BH_AssetPack* assets, const char* name
+);
+/* Decodes all of the PNGs at once on `jobs`, then uploads them in order.
+ * Fills in a region for each, BH_NO_TEXTURE for those that failed to load,
+ * and returns false if any did. */
+bool BH_LoadTextures(
+    struct BH_Textures* textures, struct BH_JobPool* jobs, void* const* png_data,
+    const size_t* sizes, size_t count, uint16_t* regions
+);
+/* `name` is the file name of a PNG in res/assets, without its extension.
+ * Returns BH_NO_TEXTURE if there is no such image. */
+uint16_t BH_GetAtlasRegion(const struct BH_Textures* textures, const char* name);
+void BH_DeinitTextures(struct BH_Textures* textures);
 
 enum BH_SpriteFlag { BH_SPRITE_TEXT = 1 << 0, BH_SPRITE_HAS_COLOUR = 1 << 1 };
 
-/* Must be aligned to 16 bytes! */
-struct BH_InstanceData {
-    m4 transform;            /* 64 bytes */
-    struct BH_Colour colour; /* 16 bytes */
-    GLuint flags;            /* 4 byte */
-    uint32_t padding[3];     /* 12 bytes */
-};
+uint32_t BH_PackColour(struct BH_Colour colour);
 
+/* Sprites are written straight into `instances`, a persistent mapping of
+ * `instances_ssbo`. It is split into BH_BATCH_FRAMES regions, one per frame
+ * and used in turn, and a region is only written to again once its fence
+ * has signalled. The whole frame is drawn at once by BH_FinishBatch. */
 struct BH_SpriteBatch {
     struct BH_MeshHandle mesh;
-    struct BH_InstanceData instance_data[BH_BATCH_SIZE];
-    GLuint64 instance_textures[BH_BATCH_SIZE];
-    size_t count;
     GLuint instances_ssbo;
+    struct BH_Sprite* instances;
+    GLsync fences[BH_BATCH_FRAMES];
+    size_t region_size;
+    size_t region;
+    size_t first; /* first sprite of the region not drawn yet */
+    size_t count; /* sprites written to the region */
     GLuint textures_ssbo;
+    GLuint regions_ssbo;
+    /* Number of entries of either table already uploaded */
+    size_t uploaded_textures;
+    size_t uploaded_regions;
 };
 
 #define MAX_CHARACTER 128
 
 struct BH_Glyph {
-    GLuint64 texture;
+    uint16_t texture; /* region in the glyph atlas, BH_NO_TEXTURE for blank glyphs */
     int width, height;
     int bearing_x, bearing_y;
     int advance;
@@ -62,7 +110,6 @@ struct BH_Glyph {
 
 struct BH_Font {
     struct BH_Glyph glyphs[MAX_CHARACTER];
-    struct BH_Textures textures;
 };
 
 struct BH_Framebuffer {
@@ -72,7 +119,78 @@ struct BH_Framebuffer {
     GLuint rbo;
 };
 
+struct BH_UIText {
+    float x, y, scale;
+    struct BH_Colour colour;
+    char* text; /* owned by the layer */
+};
+
+/* Retained text, drawn into its own texture only when some of it changes.
+ * Every frame then only composites that texture, as a single quad. */
+struct BH_UILayer {
+    struct BH_Framebuffer framebuffer;
+    uint32_t texture; /* index of `framebuffer.color_buffer`'s handle */
+    uint16_t region;
+    struct BH_UIText* texts;
+    size_t count;
+    size_t capacity;
+    bool dirty;
+};
+
+#define BH_INVALID_UI_TEXT SIZE_MAX
+
+/* Pixel buffers of the streaming ring, each holds one texture at a time */
+#define BH_STREAM_BUFFERS 3
+#define BH_STREAM_BUFFER_SIZE (4 * 1024 * 1024)
+
+enum BH_StreamState {
+    BH_STREAM_DECODING,
+    BH_STREAM_DECODED,
+    BH_STREAM_UPLOADING,
+    BH_STREAM_FAILED,
+};
+
+struct BH_TextureStream {
+    struct BH_TextureStreamer* streamer;
+    uint32_t texture; /* entry in the texture table, showing the placeholder */
+    void* png_data;
+    size_t size;
+    /* Written by the decode job, under the streamer's lock */
+    void* pixels;
+    size_t width, height;
+    enum BH_StreamState state;
+    /* Once uploading. `buffer` is BH_STREAM_BUFFERS if it did not fit. */
+    GLuint texture_id;
+    size_t buffer;
+    GLsync fence;
+};
+
+/* Textures from BH_LoadTextureAsync are decoded on a job and copied into
+ * one of the pixel buffers, which the GPU uploads from. Their entry in the
+ * texture table shares the white texture's handle until that upload's
+ * fence has signalled, and is then swapped for the real one. */
+struct BH_TextureStreamer {
+    struct BH_JobPool* jobs;
+    pthread_mutex_t lock;
+    GLuint pbo;
+    unsigned char* buffers; /* persistently mapped */
+    bool buffer_busy[BH_STREAM_BUFFERS];
+    struct BH_TextureStream** streams;
+    size_t count;
+    size_t capacity;
+};
+
+struct BH_RenderStats {
+    size_t sprites;
+    size_t draw_calls;
+    size_t bytes_uploaded;
+};
+
 struct BH_Renderer {
+    /* Set before BH_InitRenderer to skip all of GLFW and GL. Sprites are
+     * then only counted, in `stats`. */
+    bool headless;
+
     GLFWwindow* window;
     int width, height;
 
@@ -85,12 +203,18 @@ struct BH_Renderer {
     struct BH_Textures textures;
     struct BH_SpriteBatch batch;
 
-    FT_Library ft;
+    struct BH_RenderStats stats;            /* of the frame being drawn */
+    struct BH_RenderStats last_frame_stats; /* of the previous frame */
+
     struct BH_Font font;
+
+    struct BH_UILayer ui;
+    struct BH_TextureStreamer streamer;
 };
 
 struct BH_SpriteBatch BH_InitBatch(void);
 void BH_RenderBatch(struct BH_Renderer* batch, struct BH_Sprite sprite);
+/* Draws what is left, once at the end of every frame */
 void BH_FinishBatch(struct BH_Renderer* batch);
 void BH_DeinitBatch(struct BH_SpriteBatch batch);
 
@@ -99,7 +223,22 @@ void BH_RenderText(
     const char* text
 );
 
-bool BH_InitRenderer(struct BH_Renderer* renderer);
+/* Returns an id for BH_SetUIText, or BH_INVALID_UI_TEXT */
+size_t BH_AddUIText(
+    struct BH_Renderer* renderer, float x, float y, float scale, struct BH_Colour colour,
+    const char* text
+);
+void BH_SetUIText(struct BH_Renderer* renderer, size_t id, const char* text);
+
+/* Returns at once, with a region that shows a plain white texture until
+ * the image has been decoded and uploaded, a few frames later. `png_data`
+ * must stay valid until then, as assets in the pack do. */
+uint16_t BH_LoadTextureAsync(struct BH_Renderer* renderer, void* png_data, size_t size);
+
+/* `assets` must stay open until BH_DeinitRenderer */
+bool BH_InitRenderer(
+    struct BH_Renderer* renderer, const struct BH_AssetPack* assets, struct BH_JobPool* jobs
+);
 void BH_RendererBeginFrame(struct BH_Renderer* renderer);
 void BH_RendererEndFrame(struct BH_Renderer* renderer);
 void BH_DeinitRenderer(struct BH_Renderer* renderer);
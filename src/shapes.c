@@ -0,0 +1,436 @@
+#include "shapes.h"
+#include "spatial.h"
+
+#include <float.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* The AVX2 kernels are compiled for that target on their own, so the rest
+ * of the build still runs anywhere, and only picked if the CPU has it */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHAPES_AVX2
+#include <immintrin.h>
+#endif
+
+/* The shape a batch is tested against, both as a box grown by `radius`
+ * and as a segment from `a` along `d`. Capsules use the latter. */
+struct Query {
+    float min_x, min_y, max_x, max_y;
+    float radius;
+    float ax, ay, dx, dy;
+    float inv_length_sq; /* 0 for a point */
+};
+
+typedef uint32_t (*KernelFn)(const struct Query* query, const struct BH_ShapeBatch* batch);
+
+struct Kernels {
+    KernelFn boxes;    /* for circles and boxes against lanes of both */
+    KernelFn segments; /* for capsules, only right for lanes of circles */
+};
+
+/* Same as the SSE instructions, down to which side a NaN gives */
+static float Max(float a, float b) {
+    return a > b ? a : b;
+}
+
+static float Min(float a, float b) {
+    return a < b ? a : b;
+}
+
+static struct Query MakeQuery(struct BH_Shape shape) {
+    struct Query query = {
+        .min_x = shape.a.x,
+        .min_y = shape.a.y,
+        .max_x = shape.a.x,
+        .max_y = shape.a.y,
+        .radius = shape.radius,
+        .ax = shape.a.x,
+        .ay = shape.a.y,
+    };
+
+    if (shape.type == BH_SHAPE_BOX) {
+        query.max_x = shape.b.x;
+        query.max_y = shape.b.y;
+        query.radius = 0.0f;
+    } else if (shape.type == BH_SHAPE_CAPSULE) {
+        query.dx = shape.b.x - shape.a.x;
+        query.dy = shape.b.y - shape.a.y;
+        float length_sq = query.dx * query.dx + query.dy * query.dy;
+        query.inv_length_sq = length_sq > 0.0f ? 1.0f / length_sq : 0.0f;
+    }
+
+    return query;
+}
+
+/* Whether the gap between two boxes is within their radii */
+static bool BoxHit(
+    const struct Query* query, float min_x, float min_y, float max_x, float max_y, float radius
+) {
+    float gap_x = Max(Max(query->min_x - max_x, min_x - query->max_x), 0.0f);
+    float gap_y = Max(Max(query->min_y - max_y, min_y - query->max_y), 0.0f);
+    float reach = query->radius + radius;
+    return gap_x * gap_x + gap_y * gap_y <= reach * reach;
+}
+
+/* Whether the point is within the radii of the segment */
+static bool SegmentHit(const struct Query* query, float x, float y, float radius) {
+    float t = ((x - query->ax) * query->dx + (y - query->ay) * query->dy) * query->inv_length_sq;
+    t = Min(Max(t, 0.0f), 1.0f);
+    float off_x = x - (query->ax + query->dx * t);
+    float off_y = y - (query->ay + query->dy * t);
+    float reach = query->radius + radius;
+    return off_x * off_x + off_y * off_y <= reach * reach;
+}
+
+static uint32_t BoxesScalar(const struct Query* query, const struct BH_ShapeBatch* batch) {
+    uint32_t hits = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        if (BoxHit(
+                query, batch->min_x[i], batch->min_y[i], batch->max_x[i], batch->max_y[i],
+                batch->radius[i]
+            )) {
+            hits |= 1u << i;
+        }
+    }
+    return hits;
+}
+
+static uint32_t SegmentsScalar(const struct Query* query, const struct BH_ShapeBatch* batch) {
+    uint32_t hits = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        if (SegmentHit(query, batch->min_x[i], batch->min_y[i], batch->radius[i])) {
+            hits |= 1u << i;
+        }
+    }
+    return hits;
+}
+
+#ifdef __SSE2__
+static uint32_t BoxesSSE(const struct Query* query, const struct BH_ShapeBatch* batch) {
+    __m128 zero = _mm_setzero_ps();
+    __m128 q_min_x = _mm_set1_ps(query->min_x);
+    __m128 q_min_y = _mm_set1_ps(query->min_y);
+    __m128 q_max_x = _mm_set1_ps(query->max_x);
+    __m128 q_max_y = _mm_set1_ps(query->max_y);
+    __m128 q_radius = _mm_set1_ps(query->radius);
+
+    uint32_t hits = 0;
+    for (size_t i = 0; i < BH_SHAPE_BATCH; i += 4) {
+        __m128 min_x = _mm_loadu_ps(&batch->min_x[i]);
+        __m128 min_y = _mm_loadu_ps(&batch->min_y[i]);
+        __m128 max_x = _mm_loadu_ps(&batch->max_x[i]);
+        __m128 max_y = _mm_loadu_ps(&batch->max_y[i]);
+
+        __m128 gap_x = _mm_max_ps(_mm_sub_ps(q_min_x, max_x), _mm_sub_ps(min_x, q_max_x));
+        __m128 gap_y = _mm_max_ps(_mm_sub_ps(q_min_y, max_y), _mm_sub_ps(min_y, q_max_y));
+        gap_x = _mm_max_ps(gap_x, zero);
+        gap_y = _mm_max_ps(gap_y, zero);
+        __m128 reach = _mm_add_ps(q_radius, _mm_loadu_ps(&batch->radius[i]));
+
+        __m128 gap_sq = _mm_add_ps(_mm_mul_ps(gap_x, gap_x), _mm_mul_ps(gap_y, gap_y));
+        __m128 hit = _mm_cmple_ps(gap_sq, _mm_mul_ps(reach, reach));
+        hits |= (uint32_t)_mm_movemask_ps(hit) << i;
+    }
+    return hits;
+}
+
+static uint32_t SegmentsSSE(const struct Query* query, const struct BH_ShapeBatch* batch) {
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 a_x = _mm_set1_ps(query->ax);
+    __m128 a_y = _mm_set1_ps(query->ay);
+    __m128 d_x = _mm_set1_ps(query->dx);
+    __m128 d_y = _mm_set1_ps(query->dy);
+    __m128 inv_length_sq = _mm_set1_ps(query->inv_length_sq);
+    __m128 q_radius = _mm_set1_ps(query->radius);
+
+    uint32_t hits = 0;
+    for (size_t i = 0; i < BH_SHAPE_BATCH; i += 4) {
+        __m128 x = _mm_loadu_ps(&batch->min_x[i]);
+        __m128 y = _mm_loadu_ps(&batch->min_y[i]);
+
+        __m128 t = _mm_add_ps(
+            _mm_mul_ps(_mm_sub_ps(x, a_x), d_x), _mm_mul_ps(_mm_sub_ps(y, a_y), d_y)
+        );
+        t = _mm_mul_ps(t, inv_length_sq);
+        t = _mm_min_ps(_mm_max_ps(t, zero), one);
+
+        __m128 off_x = _mm_sub_ps(x, _mm_add_ps(a_x, _mm_mul_ps(d_x, t)));
+        __m128 off_y = _mm_sub_ps(y, _mm_add_ps(a_y, _mm_mul_ps(d_y, t)));
+        __m128 reach = _mm_add_ps(q_radius, _mm_loadu_ps(&batch->radius[i]));
+
+        __m128 off_sq = _mm_add_ps(_mm_mul_ps(off_x, off_x), _mm_mul_ps(off_y, off_y));
+        __m128 hit = _mm_cmple_ps(off_sq, _mm_mul_ps(reach, reach));
+        hits |= (uint32_t)_mm_movemask_ps(hit) << i;
+    }
+    return hits;
+}
+#endif // __SSE2__
+
+#ifdef SHAPES_AVX2
+__attribute__((target("avx2"))) static uint32_t BoxesAVX2(
+    const struct Query* query, const struct BH_ShapeBatch* batch
+) {
+    __m256 zero = _mm256_setzero_ps();
+    __m256 q_min_x = _mm256_set1_ps(query->min_x);
+    __m256 q_min_y = _mm256_set1_ps(query->min_y);
+    __m256 q_max_x = _mm256_set1_ps(query->max_x);
+    __m256 q_max_y = _mm256_set1_ps(query->max_y);
+    __m256 q_radius = _mm256_set1_ps(query->radius);
+
+    uint32_t hits = 0;
+    for (size_t i = 0; i < BH_SHAPE_BATCH; i += 8) {
+        __m256 min_x = _mm256_loadu_ps(&batch->min_x[i]);
+        __m256 min_y = _mm256_loadu_ps(&batch->min_y[i]);
+        __m256 max_x = _mm256_loadu_ps(&batch->max_x[i]);
+        __m256 max_y = _mm256_loadu_ps(&batch->max_y[i]);
+
+        __m256 gap_x =
+            _mm256_max_ps(_mm256_sub_ps(q_min_x, max_x), _mm256_sub_ps(min_x, q_max_x));
+        __m256 gap_y =
+            _mm256_max_ps(_mm256_sub_ps(q_min_y, max_y), _mm256_sub_ps(min_y, q_max_y));
+        gap_x = _mm256_max_ps(gap_x, zero);
+        gap_y = _mm256_max_ps(gap_y, zero);
+        __m256 reach = _mm256_add_ps(q_radius, _mm256_loadu_ps(&batch->radius[i]));
+
+        __m256 gap_sq =
+            _mm256_add_ps(_mm256_mul_ps(gap_x, gap_x), _mm256_mul_ps(gap_y, gap_y));
+        __m256 hit = _mm256_cmp_ps(gap_sq, _mm256_mul_ps(reach, reach), _CMP_LE_OQ);
+        hits |= (uint32_t)_mm256_movemask_ps(hit) << i;
+    }
+    return hits;
+}
+
+__attribute__((target("avx2"))) static uint32_t SegmentsAVX2(
+    const struct Query* query, const struct BH_ShapeBatch* batch
+) {
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 a_x = _mm256_set1_ps(query->ax);
+    __m256 a_y = _mm256_set1_ps(query->ay);
+    __m256 d_x = _mm256_set1_ps(query->dx);
+    __m256 d_y = _mm256_set1_ps(query->dy);
+    __m256 inv_length_sq = _mm256_set1_ps(query->inv_length_sq);
+    __m256 q_radius = _mm256_set1_ps(query->radius);
+
+    uint32_t hits = 0;
+    for (size_t i = 0; i < BH_SHAPE_BATCH; i += 8) {
+        __m256 x = _mm256_loadu_ps(&batch->min_x[i]);
+        __m256 y = _mm256_loadu_ps(&batch->min_y[i]);
+
+        __m256 t = _mm256_add_ps(
+            _mm256_mul_ps(_mm256_sub_ps(x, a_x), d_x), _mm256_mul_ps(_mm256_sub_ps(y, a_y), d_y)
+        );
+        t = _mm256_mul_ps(t, inv_length_sq);
+        t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+
+        __m256 off_x = _mm256_sub_ps(x, _mm256_add_ps(a_x, _mm256_mul_ps(d_x, t)));
+        __m256 off_y = _mm256_sub_ps(y, _mm256_add_ps(a_y, _mm256_mul_ps(d_y, t)));
+        __m256 reach = _mm256_add_ps(q_radius, _mm256_loadu_ps(&batch->radius[i]));
+
+        __m256 off_sq =
+            _mm256_add_ps(_mm256_mul_ps(off_x, off_x), _mm256_mul_ps(off_y, off_y));
+        __m256 hit = _mm256_cmp_ps(off_sq, _mm256_mul_ps(reach, reach), _CMP_LE_OQ);
+        hits |= (uint32_t)_mm256_movemask_ps(hit) << i;
+    }
+    return hits;
+}
+#endif // SHAPES_AVX2
+
+/* NULL for kernels this build has no code for */
+static const struct Kernels KERNELS[BH_SHAPE_KERNEL_COUNT] = {
+    [BH_SHAPE_KERNEL_SCALAR] = { BoxesScalar, SegmentsScalar },
+#ifdef __SSE2__
+    [BH_SHAPE_KERNEL_SSE2] = { BoxesSSE, SegmentsSSE },
+#endif
+#ifdef SHAPES_AVX2
+    [BH_SHAPE_KERNEL_AVX2] = { BoxesAVX2, SegmentsAVX2 },
+#endif
+};
+
+static const struct Kernels* active_kernels = NULL;
+static enum BH_ShapeKernel active_kernel = BH_SHAPE_KERNEL_SCALAR;
+
+bool BH_IsShapeKernelSupported(enum BH_ShapeKernel kernel) {
+    if (kernel >= BH_SHAPE_KERNEL_COUNT || KERNELS[kernel].boxes == NULL) {
+        return false;
+    }
+
+#ifdef SHAPES_AVX2
+    if (kernel == BH_SHAPE_KERNEL_AVX2) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+
+    /* SSE2 is only compiled in when the build already requires it */
+    return true;
+}
+
+enum BH_ShapeKernel BH_GetShapeKernel(void) {
+    if (active_kernels == NULL) {
+        enum BH_ShapeKernel kernel = BH_SHAPE_KERNEL_COUNT;
+        while (!BH_SetShapeKernel(--kernel)) {
+        }
+    }
+    return active_kernel;
+}
+
+bool BH_SetShapeKernel(enum BH_ShapeKernel kernel) {
+    if (!BH_IsShapeKernelSupported(kernel)) {
+        return false;
+    }
+
+    active_kernels = &KERNELS[kernel];
+    active_kernel = kernel;
+    return true;
+}
+
+struct BH_Shape BH_ShapeToWorld(struct BH_Shape shape, struct BH_BB bb, struct vec2 position) {
+    if (shape.type == BH_SHAPE_BOX) {
+        struct BH_BB world = BH_BoxToWorld(position, bb);
+        shape.a = world.top_left;
+        shape.b = world.bottom_right;
+        return shape;
+    }
+
+    shape.a = (struct vec2){ position.x + shape.a.x, position.y + shape.a.y };
+    shape.b = (struct vec2){ position.x + shape.b.x, position.y + shape.b.y };
+    return shape;
+}
+
+static float Cross(struct vec2 o, struct vec2 a, struct vec2 b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+static float PointSegmentDistanceSq(struct vec2 point, struct vec2 a, struct vec2 b) {
+    struct Query segment = MakeQuery((struct BH_Shape){ BH_SHAPE_CAPSULE, a, b, 0.0f });
+    float t = ((point.x - a.x) * segment.dx + (point.y - a.y) * segment.dy) *
+              segment.inv_length_sq;
+    t = Min(Max(t, 0.0f), 1.0f);
+    float off_x = point.x - (a.x + segment.dx * t);
+    float off_y = point.y - (a.y + segment.dy * t);
+    return off_x * off_x + off_y * off_y;
+}
+
+/* Closest points of two segments that do not cross are at an endpoint of
+ * one of them. Touching or overlapping ones have an endpoint at 0. */
+static float SegmentsDistanceSq(struct vec2 a, struct vec2 b, struct vec2 c, struct vec2 d) {
+    if (Cross(a, b, c) * Cross(a, b, d) < 0.0f && Cross(c, d, a) * Cross(c, d, b) < 0.0f) {
+        return 0.0f;
+    }
+
+    return Min(
+        Min(PointSegmentDistanceSq(a, c, d), PointSegmentDistanceSq(b, c, d)),
+        Min(PointSegmentDistanceSq(c, a, b), PointSegmentDistanceSq(d, a, b))
+    );
+}
+
+/* As above, with the box's corners and edges, unless the segment is in it */
+static float SegmentBoxDistanceSq(struct vec2 a, struct vec2 b, struct BH_BB box) {
+    /* Distances along an unnormalised ray are fractions of the segment */
+    struct vec2 direction = { b.x - a.x, b.y - a.y };
+    float distance;
+    if (BH_RayHitsBox(a, direction, box, 1.0f, &distance)) {
+        return 0.0f;
+    }
+
+    struct vec2 corners[4] = {
+        box.top_left,
+        { box.bottom_right.x, box.top_left.y },
+        box.bottom_right,
+        { box.top_left.x, box.bottom_right.y },
+    };
+
+    float distance_sq = FLT_MAX;
+    for (size_t i = 0; i < 4; i++) {
+        struct vec2 next = corners[(i + 1) % 4];
+        distance_sq = Min(distance_sq, SegmentsDistanceSq(a, b, corners[i], next));
+    }
+    return distance_sq;
+}
+
+bool BH_DoShapesOverlap(struct BH_Shape shape, struct BH_Shape other) {
+    if (shape.type != BH_SHAPE_CAPSULE && other.type == BH_SHAPE_CAPSULE) {
+        return BH_DoShapesOverlap(other, shape);
+    }
+
+    struct Query query = MakeQuery(shape);
+    struct Query lane = MakeQuery(other);
+
+    if (shape.type != BH_SHAPE_CAPSULE) {
+        return BoxHit(&query, lane.min_x, lane.min_y, lane.max_x, lane.max_y, lane.radius);
+    }
+
+    if (other.type == BH_SHAPE_CIRCLE) {
+        return SegmentHit(&query, other.a.x, other.a.y, other.radius);
+    }
+
+    float distance_sq;
+    if (other.type == BH_SHAPE_CAPSULE) {
+        distance_sq = SegmentsDistanceSq(shape.a, shape.b, other.a, other.b);
+    } else {
+        distance_sq = SegmentBoxDistanceSq(shape.a, shape.b, (struct BH_BB){ other.a, other.b });
+    }
+
+    float reach = shape.radius + other.radius;
+    return distance_sq <= reach * reach;
+}
+
+void BH_ClearShapeBatch(struct BH_ShapeBatch* batch) {
+    batch->boxes = 0;
+    batch->count = 0;
+}
+
+bool BH_AddToShapeBatch(struct BH_ShapeBatch* batch, struct BH_Shape shape, size_t id) {
+    if (batch->count >= BH_SHAPE_BATCH || shape.type == BH_SHAPE_CAPSULE) {
+        return false;
+    }
+
+    struct Query lane = MakeQuery(shape);
+    size_t i = batch->count++;
+    batch->min_x[i] = lane.min_x;
+    batch->min_y[i] = lane.min_y;
+    batch->max_x[i] = lane.max_x;
+    batch->max_y[i] = lane.max_y;
+    batch->radius[i] = lane.radius;
+    batch->ids[i] = id;
+
+    if (shape.type == BH_SHAPE_BOX) {
+        batch->boxes |= 1u << i;
+    }
+    return true;
+}
+
+uint32_t BH_CollideShapeBatch(struct BH_Shape shape, const struct BH_ShapeBatch* batch) {
+    if (active_kernels == NULL) {
+        BH_GetShapeKernel();
+    }
+
+    uint32_t lanes = (uint32_t)((1ull << batch->count) - 1);
+    struct Query query = MakeQuery(shape);
+
+    if (shape.type != BH_SHAPE_CAPSULE) {
+        return active_kernels->boxes(&query, batch) & lanes;
+    }
+
+    /* Capsules against boxes are rare enough to test one by one */
+    uint32_t hits = active_kernels->segments(&query, batch) & lanes & ~batch->boxes;
+    for (size_t i = 0; i < batch->count; i++) {
+        if (!(batch->boxes & 1u << i)) {
+            continue;
+        }
+
+        struct BH_Shape box = {
+            .type = BH_SHAPE_BOX,
+            .a = { batch->min_x[i], batch->min_y[i] },
+            .b = { batch->max_x[i], batch->max_y[i] },
+        };
+        if (BH_DoShapesOverlap(shape, box)) {
+            hits |= 1u << i;
+        }
+    }
+    return hits;
+}
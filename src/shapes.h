@@ -0,0 +1,53 @@
+#pragma once
+
+#include "entitydef.h"
+#include "matrix.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shapes tested by one kernel call, one bit each in the hit mask */
+#define BH_SHAPE_BATCH 16
+
+/* Moves an entity's shape to world space. A box becomes `bb` there, from
+ * `a` to `b`. */
+struct BH_Shape BH_ShapeToWorld(struct BH_Shape shape, struct BH_BB bb, struct vec2 position);
+/* Both in world space. Touching counts as overlapping, as for boxes. */
+bool BH_DoShapesOverlap(struct BH_Shape shape, struct BH_Shape other);
+
+/* Circles and boxes in world space, one array per field so the kernels
+ * load 4 or 8 at a time. Both are stored as boxes grown by a radius:
+ * circles as a point with one, boxes with none. Lanes past `count` hold
+ * leftovers, which the kernels test and then mask off, so a batch must
+ * start out zeroed. */
+struct BH_ShapeBatch {
+    float min_x[BH_SHAPE_BATCH];
+    float min_y[BH_SHAPE_BATCH];
+    float max_x[BH_SHAPE_BATCH];
+    float max_y[BH_SHAPE_BATCH];
+    float radius[BH_SHAPE_BATCH];
+    size_t ids[BH_SHAPE_BATCH]; /* whatever the caller knows the shapes by */
+    uint32_t boxes;             /* bits of the lanes holding boxes */
+    size_t count;
+};
+
+void BH_ClearShapeBatch(struct BH_ShapeBatch* batch);
+/* Returns false if the batch is full, or for a capsule, which has no lane
+ * layout and must go through BH_DoShapesOverlap instead */
+bool BH_AddToShapeBatch(struct BH_ShapeBatch* batch, struct BH_Shape shape, size_t id);
+/* Bit `i` is set if `shape`, in world space, overlaps lane `i` */
+uint32_t BH_CollideShapeBatch(struct BH_Shape shape, const struct BH_ShapeBatch* batch);
+
+/* All give the same masks. The best one the CPU supports is picked the
+ * first time a batch is tested. */
+enum BH_ShapeKernel {
+    BH_SHAPE_KERNEL_SCALAR,
+    BH_SHAPE_KERNEL_SSE2, /* 4 lanes at a time */
+    BH_SHAPE_KERNEL_AVX2, /* 8 lanes at a time */
+    BH_SHAPE_KERNEL_COUNT,
+};
+
+bool BH_IsShapeKernelSupported(enum BH_ShapeKernel kernel);
+enum BH_ShapeKernel BH_GetShapeKernel(void);
+/* Returns false, keeping the current one, if `kernel` is not supported */
+bool BH_SetShapeKernel(enum BH_ShapeKernel kernel);
@@ -0,0 +1,127 @@
+#include "spatial.h"
+#include "matrix.h"
+#include <math.h>
+
+bool BH_IsPointInBox(struct BH_BB box, struct vec2 point) {
+    return point.x >= box.top_left.x && point.x <= box.bottom_right.x &&
+           point.y >= box.top_left.y && point.y <= box.bottom_right.y;
+}
+
+bool BH_DoBoxesIntersect(struct BH_BB box, struct BH_BB other) {
+    return box.top_left.x <= other.bottom_right.x && box.bottom_right.x >= other.top_left.x &&
+           box.top_left.y <= other.bottom_right.y && box.bottom_right.y >= other.top_left.y;
+}
+
+struct vec2 BH_BoxCentre(struct BH_BB bb) {
+    return (struct vec2){ (bb.top_left.x + bb.bottom_right.x) / 2.0f,
+                          (bb.top_left.y + bb.bottom_right.y) / 2.0f };
+}
+
+struct vec2 BH_BoxDimensions(struct BH_BB bb) {
+    return (struct vec2){ bb.bottom_right.x - bb.top_left.x, bb.bottom_right.y - bb.top_left.y };
+}
+
+struct BH_BB BH_BoxToWorld(struct vec2 centre, struct BH_BB dimensions) {
+    return (struct BH_BB){
+        .top_left = vec2_add(dimensions.top_left, centre),
+        .bottom_right = vec2_add(dimensions.bottom_right, centre),
+    };
+}
+
+float BH_BoxDistance(struct BH_BB box, struct vec2 point) {
+    float dx = fmaxf(fmaxf(box.top_left.x - point.x, point.x - box.bottom_right.x), 0.0f);
+    float dy = fmaxf(fmaxf(box.top_left.y - point.y, point.y - box.bottom_right.y), 0.0f);
+    return sqrtf(dx * dx + dy * dy);
+}
+
+/* Narrows [*enter, *exit] to where the ray is between `min` and `max` on
+ * one axis. Going parallel to the axis gives infinite or NaN distances,
+ * which fminf and fmaxf sort out. */
+static void ClipSlab(float origin, float direction, float min, float max, float* enter, float* exit) {
+    float inverse = 1.0f / direction;
+    float near = (min - origin) * inverse;
+    float far = (max - origin) * inverse;
+
+    if (inverse < 0.0f) {
+        float swap = near;
+        near = far;
+        far = swap;
+    }
+
+    *enter = fmaxf(*enter, near);
+    *exit = fminf(*exit, far);
+}
+
+bool BH_RayHitsBox(
+    struct vec2 origin, struct vec2 direction, struct BH_BB box, float max_distance, float* distance
+) {
+    float enter = 0.0f;
+    float exit = max_distance;
+
+    ClipSlab(origin.x, direction.x, box.top_left.x, box.bottom_right.x, &enter, &exit);
+    ClipSlab(origin.y, direction.y, box.top_left.y, box.bottom_right.y, &enter, &exit);
+
+    if (!(enter <= exit)) {
+        return false;
+    }
+
+    *distance = enter;
+    return true;
+}
+
+float BH_NearestBound(const struct BH_NearestSearch* search) {
+    if (search->count < search->k) {
+        return search->max_distance;
+    }
+    return search->hits[search->k - 1].distance;
+}
+
+void BH_OfferNearest(struct BH_NearestSearch* search, struct BH_SpatialEntity* entity) {
+    float distance = BH_BoxDistance(entity->bb, search->point);
+
+    /* Empty boxes are infinitely far, but not beyond an infinite bound */
+    if (isinf(distance)) {
+        return;
+    }
+
+    /* Ties with a full set of hits keep the ones found first */
+    bool full = search->count == search->k;
+    float bound = BH_NearestBound(search);
+    if (!(full ? distance < bound : distance <= bound)) {
+        return;
+    }
+
+    if (search->filter != NULL && !search->filter(entity, search->data)) {
+        return;
+    }
+
+    /* Insertion sort, k is small */
+    size_t i = full ? search->k - 1 : search->count++;
+    while (i > 0 && search->hits[i - 1].distance > distance) {
+        search->hits[i] = search->hits[i - 1];
+        i--;
+    }
+
+    search->hits[i] = (struct BH_SpatialHit){ .entity = entity, .distance = distance };
+}
+
+void BH_OfferRay(struct BH_RaySearch* search, struct BH_SpatialEntity* entity) {
+    float distance;
+    if (!BH_RayHitsBox(
+            search->origin, search->direction, entity->bb, search->max_distance, &distance
+        )) {
+        return;
+    }
+
+    /* Ties keep the entity found first */
+    if (search->hit.entity != NULL && distance >= search->hit.distance) {
+        return;
+    }
+
+    if (search->filter != NULL && !search->filter(entity, search->data)) {
+        return;
+    }
+
+    search->hit = (struct BH_SpatialHit){ .entity = entity, .distance = distance };
+    search->max_distance = distance;
+}
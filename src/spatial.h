@@ -0,0 +1,75 @@
+#pragma once
+
+#include "entitydef.h"
+#include "matrix.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+bool BH_IsPointInBox(struct BH_BB box, struct vec2 point);
+bool BH_DoBoxesIntersect(struct BH_BB box, struct BH_BB other);
+
+struct vec2 BH_BoxCentre(struct BH_BB bb);
+struct vec2 BH_BoxDimensions(struct BH_BB bb);
+struct BH_BB BH_BoxToWorld(struct vec2 centre, struct BH_BB dimensions);
+
+/* What every broadphase stores. `point` is where the entity is, `bb` is
+ * what queries test. */
+struct BH_SpatialEntity {
+    struct vec2 point;
+    struct BH_BB bb; /* in world space */
+    struct BH_EntityHandle handle;
+};
+
+/* Called by queries for every entity found, in no particular order.
+ * Returning false stops the query there. `entity` points into the
+ * structure that was queried, so it is only valid until that is next
+ * cleared. */
+typedef bool (*BH_SpatialVisitCB)(struct BH_SpatialEntity* entity, void* data);
+
+/* Returning false leaves the entity out of a search. NULL accepts all. */
+typedef bool (*BH_SpatialFilterCB)(const struct BH_SpatialEntity* entity, void* data);
+
+/* 0 if `point` is in `box` */
+float BH_BoxDistance(struct BH_BB box, struct vec2 point);
+/* Distance along the ray, which has a unit `direction`, to where it enters
+ * `box`, or 0 if it starts inside. False if that is beyond `max_distance`. */
+bool BH_RayHitsBox(
+    struct vec2 origin, struct vec2 direction, struct BH_BB box, float max_distance, float* distance
+);
+
+struct BH_SpatialHit {
+    struct BH_SpatialEntity* entity;
+    float distance;
+};
+
+/* A k-nearest search: each structure walks its entities roughly nearest
+ * first, offers them, and stops once BH_NearestBound rules out the rest */
+struct BH_NearestSearch {
+    struct vec2 point;
+    float max_distance;
+    BH_SpatialFilterCB filter;
+    void* data;
+
+    struct BH_SpatialHit* hits; /* the `count` best so far, nearest first */
+    size_t k;
+    size_t count;
+};
+
+/* Only entities closer than this can still make it into the hits */
+float BH_NearestBound(const struct BH_NearestSearch* search);
+void BH_OfferNearest(struct BH_NearestSearch* search, struct BH_SpatialEntity* entity);
+
+/* A raycast: structures walk the cells or nodes along the ray, offer their
+ * entities, and stop once `max_distance` is behind them. `max_distance`
+ * shrinks to the nearest hit. */
+struct BH_RaySearch {
+    struct vec2 origin;
+    struct vec2 direction; /* of unit length */
+    float max_distance;
+    BH_SpatialFilterCB filter;
+    void* data;
+
+    struct BH_SpatialHit hit; /* `entity` is NULL until something is hit */
+};
+
+void BH_OfferRay(struct BH_RaySearch* search, struct BH_SpatialEntity* entity);
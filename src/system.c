@@ -0,0 +1,70 @@
+#include "system.h"
+#include "error_macro.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SYSTEMS_START_CAPACITY 16
+#define SYSTEMS_GROW_FACTOR 2
+
+bool BH_RegisterSystem(struct BH_Systems* systems, struct BH_System system) {
+    if (system.callback == NULL) {
+        error("system.callback == NULL");
+        return false;
+    }
+
+    if (systems->count >= systems->capacity) {
+        size_t capacity =
+            systems->capacity ? systems->capacity * SYSTEMS_GROW_FACTOR : SYSTEMS_START_CAPACITY;
+        struct BH_System* grown = realloc(systems->systems, capacity * sizeof(struct BH_System));
+        if (grown == NULL) {
+            error("Failed to allocate memory");
+            return false;
+        }
+        systems->systems = grown;
+        systems->capacity = capacity;
+    }
+
+    systems->systems[systems->count++] = system;
+    return true;
+}
+
+static bool SystemMatches(const struct BH_System* system, const struct BH_EntityGroup* group) {
+    if (system->match_type && system->type != group->type) {
+        return false;
+    }
+    return (group->components & system->components) == system->components;
+}
+
+void BH_RunSystems(struct BH_Context* ctx, struct BH_Systems* systems, struct BH_EntityPool* pool) {
+    /* Spawns during a system land in the ungrouped tail, so the group
+     * ranges cannot shift under us */
+    for (size_t s = 0; s < systems->count; s++) {
+        const struct BH_System* system = &systems->systems[s];
+
+        for (size_t g = 0; g < pool->group_count; g++) {
+            const struct BH_EntityGroup* group = &pool->groups[g];
+            if (group->count == 0 || !SystemMatches(system, group)) {
+                continue;
+            }
+
+            system->callback(
+                ctx, (struct BH_EntitySpan){
+                         .pool = pool,
+                         .begin = group->begin,
+                         .count = group->count,
+                         .type = group->type,
+                         .components = group->components,
+                     }
+            );
+
+            /* Systems may have moved anything in the span */
+            memset(&pool->dirty[group->begin], 1, group->count);
+        }
+    }
+}
+
+void BH_DeinitSystems(struct BH_Systems* systems) {
+    free(systems->systems);
+    *systems = (struct BH_Systems){ 0 };
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "entities.h"
+#include "entitydef.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct BH_Context;
+
+/* A run of dense indices [begin, begin + count) in `pool`, all sharing
+ * `type` and `components`. Spawning may reallocate the pool's arrays, so
+ * pointers into them must be re-read after a spawn. */
+struct BH_EntitySpan {
+    struct BH_EntityPool* pool;
+    size_t begin;
+    size_t count;
+    enum BH_EntityType type;
+    uint32_t components;
+};
+
+typedef void (*BH_SystemCB)(struct BH_Context* ctx, struct BH_EntitySpan span);
+
+/* Called once per tick for every entity group that has all of
+ * `components` and, if `match_type` is set, is of `type`. */
+struct BH_System {
+    BH_SystemCB callback;
+    uint32_t components;
+    bool match_type;
+    enum BH_EntityType type;
+};
+
+struct BH_Systems {
+    struct BH_System* systems;
+    size_t count;
+    size_t capacity;
+};
+
+bool BH_RegisterSystem(struct BH_Systems* systems, struct BH_System system);
+void BH_RunSystems(struct BH_Context* ctx, struct BH_Systems* systems, struct BH_EntityPool* pool);
+void BH_DeinitSystems(struct BH_Systems* systems);
@@ -0,0 +1,27 @@
+#include "transform.h"
+#include "matrix.h"
+
+#include <math.h>
+
+void BH_UpdateTransforms(struct BH_EntityPool* pool) {
+    for (size_t i = 0; i < pool->count; i++) {
+        if (!pool->dirty[i]) {
+            continue;
+        }
+
+        struct BH_Sprite* sprite = &pool->sprites[i];
+        sprite->position = pool->positions[i];
+        sprite->half_size = pool->scales[i];
+        sprite->depth = pool->depths[i];
+
+        float rotation = pool->rotations[i];
+        if (rotation != pool->cached_rotations[i]) {
+            sprite->rotation = pack_snorm2x16(cosf(rotation), sinf(rotation));
+            pool->cached_rotations[i] = rotation;
+        }
+
+        pool->dirty[i] = 0;
+    }
+}
+
+void BH_MarkEntityDirty(struct BH_EntityPool* pool, size_t entity) { pool->dirty[entity] = 1; }
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "entities.h"
+
+/* Copies position, scale, rotation and depth into `sprites[i]` for every
+ * entity flagged in `dirty`. The packed sine and cosine of the rotation
+ * are only recomputed when it changes. */
+void BH_UpdateTransforms(struct BH_EntityPool* pool);
+
+/* For code that moves entities outside of systems and callbacks, which
+ * flag what they touch on their own */
+void BH_MarkEntityDirty(struct BH_EntityPool* pool, size_t entity);